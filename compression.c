@@ -0,0 +1,480 @@
+/*
+ * flow: a Smalltalk streaming framework
+ * version 3
+ *
+ * compression.c - streaming compression for sockets and pipelines
+ *
+ * Craig Latta
+ * netjam.org/flow
+ */
+
+/*
+ * Compressing in Smalltalk before each write is far slower than
+ * the link it saves. Instead, a socket with a send queue may
+ * compress what's written to it natively, on the way into the
+ * queue, and a socket with a receive queue may decompress what
+ * arrives, on the way into the queue. The image reads and writes
+ * plain bytes, and the watermarks and framing work as before (on
+ * compressed bytes when sending, and on decompressed ones when
+ * receiving). Pipelines use the same codecs for their compression
+ * and decompression stages.
+ *
+ * A compressor holds back what it has compressed until it flushes,
+ * so that a peer can only decompress what's been flushed. Each
+ * compressor flushes after a given number of bytes has been written
+ * since the last flush, or after every write.
+ *
+ * The codecs are deflate, from zlib, and LZ4 (with its frame format).
+ * Each is built only when DEFLATE or LZ4 is defined, respectively,
+ * since neither library is a given on every build host; a codec
+ * which wasn't built is rejected. Each codec counts the bytes it
+ * took and gave, and the CPU time it spent.
+ */
+
+#include "flow.h"
+extern struct VirtualMachine *vm;
+
+#ifdef UNIXISH
+
+/*
+ * utilities
+ */
+
+#ifdef DEFLATE
+static int runDeflate(
+		      codec *codecPointer,
+		      char  **input,
+		      int   *inputCount,
+		      char  *output,
+		      int   outputSize,
+		      int   flush) {
+  z_stream *stream = &codecPointer->zlib;
+  int	   result;
+
+
+  stream->next_in = (Bytef *) *input;
+  stream->avail_in = *inputCount;
+  stream->next_out = (Bytef *) output;
+  stream->avail_out = outputSize;
+
+  if (codecPointer->compressing) {
+    result = deflate(
+		     stream,
+		     (flush == codecFinish)
+		     ? Z_FINISH
+		     : ((flush == codecFlush) ? Z_SYNC_FLUSH : Z_NO_FLUSH));
+    if (result == Z_STREAM_END) codecPointer->finished = TRUE;}
+  else {
+    result = inflate(stream, Z_NO_FLUSH);
+    /* Another stream may follow the one which ended. */
+    if (result == Z_STREAM_END) inflateReset(stream);}
+
+  if ((result == Z_STREAM_ERROR)
+      || (result == Z_DATA_ERROR)
+      || (result == Z_NEED_DICT)
+      || (result == Z_MEM_ERROR))
+    return -1;
+
+  *input += *inputCount - stream->avail_in;
+  *inputCount = stream->avail_in;
+  return outputSize - stream->avail_out;}
+#endif
+
+
+#ifdef LZ4
+static int runLZ4(
+		  codec *codecPointer,
+		  char	**input,
+		  int	*inputCount,
+		  char	*output,
+		  int	outputSize,
+		  int	flush) {
+  size_t result, taken, given;
+  int	 produced = 0, take;
+
+
+  if (!codecPointer->compressing) {
+    taken = *inputCount;
+    given = outputSize;
+    result = LZ4F_decompress(
+			     codecPointer->lz4Decompression,
+			     output,
+			     &given,
+			     *input,
+			     &taken,
+			     NULL);
+    if (LZ4F_isError(result)) return -1;
+    *input += taken;
+    *inputCount -= taken;
+    return given;}
+
+  if (!codecPointer->started) {
+    result = LZ4F_compressBegin(
+				codecPointer->lz4Compression,
+				output,
+				outputSize,
+				&codecPointer->lz4Preferences);
+    if (LZ4F_isError(result)) return -1;
+    produced = result;
+    codecPointer->started = TRUE;}
+
+  /* LZ4 wants room for the worst case of whatever it's given. */
+  take = *inputCount;
+  while ((take > 0)
+	 && (LZ4F_compressBound(take, &codecPointer->lz4Preferences) > (outputSize - produced)))
+    take /= 2;
+  if (take > 0) {
+    result = LZ4F_compressUpdate(
+				 codecPointer->lz4Compression,
+				 output + produced,
+				 outputSize - produced,
+				 *input,
+				 take,
+				 NULL);
+    if (LZ4F_isError(result)) return -1;
+    produced += result;
+    *input += take;
+    *inputCount -= take;}
+
+  if ((*inputCount == 0)
+      && (flush != codecContinue)
+      && (LZ4F_compressBound(0, &codecPointer->lz4Preferences) <= (outputSize - produced))) {
+    result = (flush == codecFinish)
+      ? LZ4F_compressEnd(
+			 codecPointer->lz4Compression,
+			 output + produced,
+			 outputSize - produced,
+			 NULL)
+      : LZ4F_flush(
+		   codecPointer->lz4Compression,
+		   output + produced,
+		   outputSize - produced,
+		   NULL);
+    if (LZ4F_isError(result)) return -1;
+    produced += result;
+    if (flush == codecFinish) codecPointer->finished = TRUE;}
+
+  return produced;}
+#endif
+
+
+/*
+ * for sockets' queues and pipelines
+ */
+
+codec *newCodec(
+		int kind,
+		int compressing,
+		int level) {
+  /* Answer NULL if the codec isn't available, or the level isn't one of its levels. */
+
+  codec *codecPointer;
+  int	started = FALSE;
+
+
+  if ((codecPointer = (codec *) calloc(1, sizeof(codec))) == NULL) return NULL;
+  codecPointer->kind = kind;
+  codecPointer->compressing = compressing;
+
+  switch (kind) {
+#ifdef DEFLATE
+  case deflateCodec:
+    started = (compressing
+	       ? deflateInit(&codecPointer->zlib, level)
+	       : inflateInit(&codecPointer->zlib))
+      == Z_OK;
+    break;
+#endif
+#ifdef LZ4
+  case lz4Codec:
+    codecPointer->lz4Preferences.compressionLevel = level;
+    started = !LZ4F_isError(compressing
+			    ? LZ4F_createCompressionContext(&codecPointer->lz4Compression, LZ4F_VERSION)
+			    : LZ4F_createDecompressionContext(&codecPointer->lz4Decompression, LZ4F_VERSION));
+    break;
+#endif
+  }
+
+  if (!started) {
+    free(codecPointer);
+    return NULL;}
+
+  codecPointer->scratchSize = compressing ? codecBound(codecPointer, CompressionChunkSize) : 0;
+  if ((compressing && ((codecPointer->scratch = (char *) malloc(codecPointer->scratchSize)) == NULL))
+      || (!compressing && ((codecPointer->pending = (char *) malloc(CompressionChunkSize)) == NULL))) {
+    freeCodec(codecPointer);
+    return NULL;}
+
+  return codecPointer;}
+
+
+int runCodec(
+	     codec *codecPointer,
+	     char  **input,
+	     int   *inputCount,
+	     char  *output,
+	     int   outputSize,
+	     int   flush) {
+  /*
+   * Code bytes from the input into the output, moving the input past
+   * what was taken. The codec may keep some input back, and may have
+   * more output than fits; call it again until it neither takes nor
+   * gives anything. Answer how many bytes were given, or -1 if the
+   * input is corrupt.
+   */
+
+  struct timespec before, after;
+  int		  available = *inputCount;
+  int		  produced = -1;
+
+
+  /* A finished stream takes and gives nothing more. */
+  if (codecPointer->finished) return 0;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &before);
+
+  switch (codecPointer->kind) {
+#ifdef DEFLATE
+  case deflateCodec:
+    produced = runDeflate(
+			  codecPointer,
+			  input,
+			  inputCount,
+			  output,
+			  outputSize,
+			  flush);
+    break;
+#endif
+#ifdef LZ4
+  case lz4Codec:
+    produced = runLZ4(
+		      codecPointer,
+		      input,
+		      inputCount,
+		      output,
+		      outputSize,
+		      flush);
+    break;
+#endif
+  }
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &after);
+  codecPointer->nanoseconds +=
+    ((after.tv_sec - before.tv_sec) * 1000000000LL) + (after.tv_nsec - before.tv_nsec);
+  if (produced < 0) return -1;
+
+  codecPointer->bytesIn += available - *inputCount;
+  codecPointer->bytesOut += produced;
+  return produced;}
+
+
+int codecBound(
+	       codec *codecPointer,
+	       int   count) {
+  /* Answer the most a compressor may give for count bytes, including a flush. */
+
+  switch (codecPointer->kind) {
+#ifdef DEFLATE
+  case deflateCodec:
+    return deflateBound(&codecPointer->zlib, count) + 16;
+#endif
+#ifdef LZ4
+  case lz4Codec:
+    return LZ4F_compressBound(count, &codecPointer->lz4Preferences) + LZ4F_HEADER_SIZE_MAX;
+#endif
+  }
+
+  return count;}
+
+
+void freeCodec(codec *codecPointer) {
+  if (codecPointer == NULL) return;
+
+  switch (codecPointer->kind) {
+#ifdef DEFLATE
+  case deflateCodec:
+    if (codecPointer->compressing)
+      deflateEnd(&codecPointer->zlib);
+    else
+      inflateEnd(&codecPointer->zlib);
+    break;
+#endif
+#ifdef LZ4
+  case lz4Codec:
+    if (codecPointer->compressing)
+      LZ4F_freeCompressionContext(codecPointer->lz4Compression);
+    else
+      LZ4F_freeDecompressionContext(codecPointer->lz4Decompression);
+    break;
+#endif
+  }
+
+  free(codecPointer->scratch);
+  free(codecPointer->pending);
+  free(codecPointer);}
+
+
+/*
+ * primitives
+ */
+
+void compressSentDataForTCPSocketCodecLevelFlushEvery(void) {
+  /*
+   * compressSentDataFor: tcpSocketHandle
+   * codec: codecNumber
+   * level: compressionLevel
+   * flushEvery: numberOfBytes
+   */
+
+  /*
+   * From now on, bytes written to the socket are compressed on their
+   * way into its send queue, which must exist already. The level is
+   * the codec's own (-1 is deflate's default). Compression can't be
+   * changed once it has begun, since the peer relies on the stream.
+   */
+
+  flowSocket *socketPointer = (flowSocket *) (addressForStackValue(3));
+  int	     kind = vm->stackIntegerValue(2);
+  int	     level = vm->stackIntegerValue(1);
+  int	     flushEvery = vm->stackIntegerValue(0);
+  sendQueue  *queue;
+  codec	     *compressor;
+
+
+  if (!(vm->failed())) {
+    queue = (sendQueue *) socketPointer->resource.sendQueue;
+    if ((queue == NULL)
+	|| (queue->compressor != NULL)
+	|| (flushEvery < 0)
+	|| ((compressor = newCodec(kind, TRUE, level)) == NULL)) {
+      vm->primitiveFail();
+      return;}
+
+    compressor->flushEvery = flushEvery;
+    pthread_mutex_lock(&queue->mutex);
+    queue->compressor = compressor;
+    pthread_mutex_unlock(&queue->mutex);
+    vm->pop(4);}}
+
+
+void decompressReceivedDataForTCPSocketCodec(void) {
+  /*
+   * decompressReceivedDataFor: tcpSocketHandle
+   * codec: codecNumber
+   */
+
+  /*
+   * From now on, bytes received by the socket are decompressed on
+   * their way into its receive queue, which must exist already.
+   * Bytes queued before are left as they are. Corrupt input fails
+   * the next read.
+   */
+
+  flowSocket   *socketPointer = (flowSocket *) (addressForStackValue(1));
+  int	       kind = vm->stackIntegerValue(0);
+  receiveQueue *queue;
+  codec	       *decompressor;
+
+
+  if (!(vm->failed())) {
+    queue = (receiveQueue *) socketPointer->resource.receiveQueue;
+    if ((queue == NULL)
+	|| (queue->decompressor != NULL)
+	|| ((decompressor = newCodec(kind, FALSE, 0)) == NULL)) {
+      vm->primitiveFail();
+      return;}
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->decompressor = decompressor;
+    pthread_mutex_unlock(&queue->mutex);
+    vm->pop(2);}}
+
+
+void flushCompressedDataForTCPSocket(void) {
+  /* flushCompressedDataFor: tcpSocketHandle */
+
+  /* Queue everything the socket's compressor is holding back, whatever its flushing interval. */
+
+  flowSocket *socketPointer = (flowSocket *) (addressForStackValue(0));
+  sendQueue  *queue;
+
+
+  if (!(vm->failed())) {
+    queue = (sendQueue *) socketPointer->resource.sendQueue;
+    if ((queue == NULL)
+	|| (queue->compressor == NULL)
+	|| !flushSendQueueCompression(&socketPointer->resource)) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(1);}}
+
+
+void compressionStatisticsForTCPSocketInto(void) {
+  /*
+   * compressionStatisticsFor: tcpSocketHandle
+   * into: fortyEightByteArray
+   */
+
+  /*
+   * Write six eight-byte integers: the bytes the socket's compressor
+   * has taken and given, and its CPU time in nanoseconds, then the
+   * same for its decompressor. Those a socket lacks are zero.
+   */
+
+  flowSocket	     *socketPointer = (flowSocket *) (addressForStackValue(1));
+  int		     statistics = vm->stackObjectValue(0);
+  sendQueue	     *sent;
+  receiveQueue	     *received;
+  unsigned long long counts[6];
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(statistics) == (vm->classByteArray()))
+	|| (vm->byteSizeOf(statistics) < sizeof(counts))) {
+      vm->primitiveFail();
+      return;}
+
+    memset(counts, 0, sizeof(counts));
+    if ((sent = (sendQueue *) socketPointer->resource.sendQueue) != NULL) {
+      pthread_mutex_lock(&sent->mutex);
+      if (sent->compressor != NULL) {
+	counts[0] = sent->compressor->bytesIn;
+	counts[1] = sent->compressor->bytesOut;
+	counts[2] = sent->compressor->nanoseconds;}
+      pthread_mutex_unlock(&sent->mutex);}
+
+    if ((received = (receiveQueue *) socketPointer->resource.receiveQueue) != NULL) {
+      pthread_mutex_lock(&received->mutex);
+      if (received->decompressor != NULL) {
+	counts[3] = received->decompressor->bytesIn;
+	counts[4] = received->decompressor->bytesOut;
+	counts[5] = received->decompressor->nanoseconds;}
+      pthread_mutex_unlock(&received->mutex);}
+
+    memcpy(
+	   (void *) (statistics + BaseHeaderSize),
+	   counts,
+	   sizeof(counts));
+    vm->pop(2);}}
+
+#else
+
+/* Without pthreads, sockets have no native queues to compress into. */
+
+void compressSentDataForTCPSocketCodecLevelFlushEvery(void) {
+  vm->primitiveFail();}
+
+
+void decompressReceivedDataForTCPSocketCodec(void) {
+  vm->primitiveFail();}
+
+
+void flushCompressedDataForTCPSocket(void) {
+  vm->primitiveFail();}
+
+
+void compressionStatisticsForTCPSocketInto(void) {
+  vm->primitiveFail();}
+
+#endif
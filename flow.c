@@ -13,6 +13,19 @@
 
 struct VirtualMachine *vm;
 
+/* the readiness model given to newly enabled TCP sockets */
+int		      readinessModel = scribingThreadsModel;
+
+#ifdef UNIXISH
+/* completions waiting for delivery to the VM */
+static completionQueue completions;
+#endif
+
+#ifdef LINUXISH
+/* a threadSync futex word's value while its thread sleeps */
+#define SleepingForRequest    2
+#endif
+
 
 /*
  * initialization/finalization
@@ -38,9 +51,12 @@ int initialiseModule(void) {
 #ifdef UNIXISH
   pthread_cond_t request = PTHREAD_COND_INITIALIZER;
   pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  int		  index;
 
   activity.request = request;
   activity.mutex = mutex;
+  for (index = 0; index < CompletionQueueSize; index++)
+    completions.entries[index].sequence = index;
 #endif
   startIP();
   //	startMIDI();
@@ -68,6 +84,12 @@ int getWindowMessageHook(HWND *windowHandle) {
 
 
 int shutdownModule(void) {
+  stopIdleLoop();
+  stopReactor();
+  stopCompletionRing();
+  stopWorkerPool();
+  stopZeroCopyReaper();
+  stopResolverPool();
   stopIP();
   //	stopMIDI();
   return TRUE;}
@@ -317,7 +339,61 @@ int startScribingThreads(
     else return TRUE;}}
 
 
+#ifdef LINUXISH
+/*
+ * On Linux, a threadSync's requestAlreadyOccurred is a futex word:
+ * FALSE, TRUE once signalled, or SleepingForRequest while its
+ * thread waits. Signalling makes a system call only when the
+ * thread is actually asleep, and neither side takes a lock.
+ */
+
+static int futex(
+		 int		 *word,
+		 int		 operation,
+		 int		 value,
+		 struct timespec *timeout) {
+  return (int) syscall(SYS_futex, word, operation, value, timeout, NULL, 0);}
+
+
+static int takeThreadSignal(threadSync *sync) {
+  int expected = TRUE;
+
+
+  return __atomic_compare_exchange_n(
+				     &sync->requestAlreadyOccurred,
+				     &expected,
+				     FALSE,
+				     FALSE,
+				     __ATOMIC_ACQUIRE,
+				     __ATOMIC_RELAXED);}
+
+
+static void announceThreadSleep(threadSync *sync) {
+  int expected = FALSE;
+
+
+  __atomic_compare_exchange_n(
+			      &sync->requestAlreadyOccurred,
+			      &expected,
+			      SleepingForRequest,
+			      FALSE,
+			      __ATOMIC_SEQ_CST,
+			      __ATOMIC_RELAXED);}
+#endif
+
+
 void waitForThreadSignal(threadSync *sync) {
+#ifdef LINUXISH
+  while (!takeThreadSignal(sync)) {
+    /* A futex wait isn't a cancellation point, as pthread_cond_wait() is. */
+    pthread_testcancel();
+    announceThreadSleep(sync);
+    futex(
+	  &sync->requestAlreadyOccurred,
+	  FUTEX_WAIT_PRIVATE,
+	  SleepingForRequest,
+	  NULL);}
+#else
 #ifdef UNIXISH
   pthread_mutex_lock(&sync->mutex);
   while(!sync->requestAlreadyOccurred) {
@@ -325,33 +401,246 @@ void waitForThreadSignal(threadSync *sync) {
   sync->requestAlreadyOccurred = FALSE;
   pthread_mutex_unlock(&sync->mutex);
 #endif
+#endif
 #ifdef WIN32
   WaitForSingleObject(sync->pendingEvent, INFINITE);
 #endif
 }
 
 
+void waitForThreadSignalFor(
+			    threadSync *sync,
+			    int	       milliseconds) {
+  /* Wait for a signal, or until the given time has elapsed. */
+
+#ifdef LINUXISH
+  struct timespec delay;
+  int		  expected = SleepingForRequest;
+
+
+  if (takeThreadSignal(sync)) return;
+
+  delay.tv_sec = milliseconds / 1000;
+  delay.tv_nsec = (milliseconds % 1000) * 1000000;
+  announceThreadSleep(sync);
+  futex(
+	&sync->requestAlreadyOccurred,
+	FUTEX_WAIT_PRIVATE,
+	SleepingForRequest,
+	&delay);
+
+  /* Leave any signal that arrived meanwhile for next time. */
+  if (!takeThreadSignal(sync))
+    __atomic_compare_exchange_n(
+				&sync->requestAlreadyOccurred,
+				&expected,
+				FALSE,
+				FALSE,
+				__ATOMIC_SEQ_CST,
+				__ATOMIC_RELAXED);
+#else
+#ifdef UNIXISH
+  struct timeval  currentTime;
+  struct timespec wakeupTime;
+
+
+  pthread_mutex_lock(&sync->mutex);
+  if (!sync->requestAlreadyOccurred) {
+    gettimeofday(&currentTime, NULL);
+    wakeupTime.tv_nsec = (currentTime.tv_usec * 1000) + ((milliseconds % 1000) * 1000000);
+    wakeupTime.tv_sec = currentTime.tv_sec + (milliseconds / 1000) + (wakeupTime.tv_nsec / 1000000000);
+    wakeupTime.tv_nsec %= 1000000000;
+
+    pthread_cond_timedwait(
+			   &sync->request,
+			   &sync->mutex,
+			   &wakeupTime);}
+  sync->requestAlreadyOccurred = FALSE;
+  pthread_mutex_unlock(&sync->mutex);
+#endif
+#endif
+#ifdef WIN32
+  WaitForSingleObject(sync->pendingEvent, milliseconds);
+#endif
+}
+
+
 void signalThread(threadSync *sync) {
+#ifdef LINUXISH
+  if (__atomic_exchange_n(
+			  &sync->requestAlreadyOccurred,
+			  TRUE,
+			  __ATOMIC_SEQ_CST)
+      == SleepingForRequest)
+    futex(
+	  &sync->requestAlreadyOccurred,
+	  FUTEX_WAKE_PRIVATE,
+	  1,
+	  NULL);
+#else
 #ifdef UNIXISH
   pthread_mutex_lock(&sync->mutex);
   sync->requestAlreadyOccurred = TRUE;
   pthread_cond_signal(&sync->request);
   pthread_mutex_unlock(&sync->mutex);
 #endif
+#endif
 #ifdef WIN32
   SetEvent(sync->pendingEvent);
 #endif
 }
 
 
-void signalSynchronizedResourceThread(thread *thread) {
-  thread->timeout = vm->stackValue(0);
-  if (thread->timeout == vm->nilObject())
-    thread->timeout = -1;
-  else if (thread->timeout < 0) thread->timeout = 0;
-  thread->operation = vm->stackIntegerValue(1);
+void readSynchronizedResourceRequest(threadRequest *request) {
+  request->timeout = vm->stackValue(0);
+  if (request->timeout == vm->nilObject())
+    request->timeout = -1;
+  else if (request->timeout < 0) request->timeout = 0;
+  request->operation = vm->stackIntegerValue(1);}
+
+
+int postThreadRequest(
+		      thread *thread,
+		      int    operation,
+		      int    timeout) {
+  /*
+   * Queue an operation for the resource's scribing thread, and wake
+   * it. Only the VM thread adds requests, and only the scribing
+   * thread takes them, so the ring needs no lock. A request
+   * identical to the last one still pending is coalesced with it,
+   * as repeated notifications were before there was a ring; the
+   * thread was signalled for it, and performs it after this call
+   * either way. Answer FALSE if the ring is full.
+   */
+
+  unsigned int	limit = thread->requestLimit, pending;
+  threadRequest *request;
+
+
+  pending = limit - __atomic_load_n(&thread->firstRequest, __ATOMIC_ACQUIRE);
+  if (pending > 0) {
+    request = &thread->requests[(limit - 1) % ThreadRequestRingSize];
+    if ((request->operation == operation) && (request->timeout == timeout))
+      return TRUE;}
+
+  if (pending == ThreadRequestRingSize)
+    return FALSE;
+
+  request = &thread->requests[limit % ThreadRequestRingSize];
+  request->operation = operation;
+  request->timeout = timeout;
+  __atomic_store_n(&thread->requestLimit, limit + 1, __ATOMIC_RELEASE);
   signalThread(&thread->sync);
-  vm->pop(3);}
+  return TRUE;}
+
+
+int signalSynchronizedResourceThread(thread *thread) {
+  /* Queue the operation requested from the stack. */
+
+  threadRequest request;
+
+
+  readSynchronizedResourceRequest(&request);
+  if (!postThreadRequest(
+			 thread,
+			 request.operation,
+			 request.timeout))
+    return FALSE;
+
+  vm->pop(3);
+  return TRUE;}
+
+
+#ifdef UNIXISH
+long long monotonicMicroseconds(void) {
+#ifdef LINUXISH
+  struct timespec now;
+
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((long long) now.tv_sec * 1000000) + (now.tv_nsec / 1000);
+#else
+  struct timeval now;
+
+
+  gettimeofday(&now, NULL);
+  return ((long long) now.tv_sec * 1000000) + now.tv_usec;
+#endif
+}
+#endif
+
+
+void waitForThreadRequest(thread *thread) {
+  /*
+   * Wait for the next request from the VM thread, and make it the
+   * thread's current operation and timeout. In low-latency mode,
+   * poll for it for a while first, so that a request made soon
+   * after the last one doesn't have to wake the thread.
+   */
+
+  unsigned int	first = thread->firstRequest;
+  threadRequest *request;
+#ifdef UNIXISH
+  long long	started;
+
+
+  if ((thread->spinBudget > 0)
+      && (__atomic_load_n(&thread->requestLimit, __ATOMIC_ACQUIRE) == first)) {
+    started = monotonicMicroseconds();
+    while ((__atomic_load_n(&thread->requestLimit, __ATOMIC_ACQUIRE) == first)
+	   && ((monotonicMicroseconds() - started) < thread->spinBudget));
+    if (__atomic_load_n(&thread->requestLimit, __ATOMIC_ACQUIRE) == first)
+      thread->requestSpinsExhausted++;
+    else thread->requestSpinsSatisfied++;}
+#endif
+
+  while (__atomic_load_n(&thread->requestLimit, __ATOMIC_ACQUIRE) == first)
+    waitForThreadSignal(&thread->sync);
+
+  request = &thread->requests[first % ThreadRequestRingSize];
+  thread->operation = request->operation;
+  thread->timeout = request->timeout;
+  __atomic_store_n(&thread->firstRequest, first + 1, __ATOMIC_RELEASE);}
+
+
+int notifySynchronizedResource(
+			       netResource *resource,
+			       thread	   *thread) {
+  /*
+   * Hand the pending operation to the resource's scribing thread,
+   * or arm it with the reactor, completion ring or worker pool.
+   * Either way, the thread's semaphore is signalled when the
+   * operation may be performed, or when the timeout elapses. Answer
+   * FALSE for a resource with no model (a UDP socket, for one),
+   * since nothing would ever notice its readiness.
+   */
+
+  threadRequest request;
+  int		armed;
+
+
+  if (resource->model == scribingThreadsModel)
+    return signalSynchronizedResourceThread(thread);
+
+  readSynchronizedResourceRequest(&request);
+  thread->operation = request.operation;
+  thread->timeout = request.timeout;
+  switch (resource->model) {
+    case reactorModel:
+      armed = armReactorOperation(resource, thread);
+      break;
+    case completionRingModel:
+      armed = armRingOperation(resource, thread);
+      break;
+    case pooledWorkersModel:
+      armed = armPooledOperation(resource, thread);
+      break;
+    default:
+      armed = FALSE;
+      break;}
+  if (!armed) return FALSE;
+  vm->pop(3);
+  return TRUE;}
 
 
 void stopThread(threadSync *sync) {
@@ -374,6 +663,14 @@ void killThread(threadSync *sync) {
 #ifdef UNIXISH
   pthread_cancel(sync->thread);
 #endif
+#ifdef LINUXISH
+  /*
+   * Signal the thread, so that its wait for a request returns and it
+   * tests for cancellation. Just waking the futex could be missed, if
+   * it came between the thread's test and its wait.
+   */
+  signalThread(sync);
+#endif
 #ifdef WIN32
   TerminateThread(sync->thread, 0);
   CloseHandle(sync->thread);
@@ -383,9 +680,187 @@ void killThread(threadSync *sync) {
 }
 
 
+void stopScribing(netResource *resource) {
+  releaseZeroCopy(resource);
+  if (resource->model == reactorModel)
+    unregisterFromReactor(resource);
+  else if (resource->model == completionRingModel)
+    detachFromCompletionRing(resource);
+  else if (resource->model == pooledWorkersModel)
+    releasePooledResource(resource);
+  else {
+    killThread(&resource->reading.sync);
+    killThread(&resource->writing.sync);
+#ifdef UNIXISH
+    /* The threads may be using the queues; let them finish dying. */
+    if (resource->receiveQueue != NULL)
+      pthread_join(resource->reading.sync.thread, NULL);
+    if (resource->sendQueue != NULL)
+      pthread_join(resource->writing.sync.thread, NULL);
+    releaseQueues(resource);
+#endif
+  }}
+
+
+int replaceResourceHandle(
+			  netResource *resource,
+			  int	      handle) {
+  /*
+   * Close the resource's descriptor and use another in its place.
+   * The reactor and completion ring track descriptors, so move the
+   * resource's registration over; scribing threads and pooled
+   * workers simply use the new handle on their next wait. Zero-copy
+   * sends, if enabled, must be enabled again for the new descriptor.
+   */
+
+  releaseZeroCopy(resource);
+  if (resource->model == reactorModel) {
+    unregisterFromReactor(resource);
+    close(resource->handle);
+    resource->handle = handle;
+    return registerWithReactor(resource);}
+
+  if (resource->model == completionRingModel) {
+    detachFromCompletionRing(resource);
+    close(resource->handle);
+    resource->handle = handle;
+    return attachToCompletionRing(resource);}
+
+  close(resource->handle);
+  resource->handle = handle;
+  return TRUE;}
+
+
+#ifdef UNIXISH
+/*
+ * Completions are queued, by any thread, without locks (after
+ * Vyukov's bounded queue). Whichever thread finds nobody else
+ * delivering takes over, delivers everything queued so far to the
+ * VM, and wakes the VM once for the whole batch. Other threads
+ * just leave their completions for it, so nobody ever waits here.
+ */
+
+static int queueCompletion(int index) {
+  unsigned int position = __atomic_load_n(&completions.enqueuePosition, __ATOMIC_RELAXED);
+  completion   *entry;
+  int	       difference;
+
+
+  for(;;) {
+    entry = &completions.entries[position % CompletionQueueSize];
+    difference = (int) (__atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE) - position);
+    if (difference == 0) {
+      if (__atomic_compare_exchange_n(
+				      &completions.enqueuePosition,
+				      &position,
+				      position + 1,
+				      TRUE,
+				      __ATOMIC_RELAXED,
+				      __ATOMIC_RELAXED))
+	break;}
+    else if (difference < 0)
+      /* full */
+      return FALSE;
+    else position = __atomic_load_n(&completions.enqueuePosition, __ATOMIC_RELAXED);}
+
+  entry->semaphoreIndex = index;
+  __atomic_store_n(&entry->sequence, position + 1, __ATOMIC_SEQ_CST);
+  return TRUE;}
+
+
+static int completionsQueued(void) {
+  unsigned int position = __atomic_load_n(&completions.dequeuePosition, __ATOMIC_SEQ_CST);
+
+
+  return
+    __atomic_load_n(
+		    &completions.entries[position % CompletionQueueSize].sequence,
+		    __ATOMIC_SEQ_CST)
+    == position + 1;}
+
+
+static int dequeueCompletion(int *index) {
+  /* Only the delivering thread calls this. */
+
+  unsigned int position = completions.dequeuePosition;
+  completion   *entry = &completions.entries[position % CompletionQueueSize];
+
+
+  if (__atomic_load_n(&entry->sequence, __ATOMIC_ACQUIRE) != position + 1)
+    return FALSE;
+
+  *index = entry->semaphoreIndex;
+  __atomic_store_n(&entry->sequence, position + CompletionQueueSize, __ATOMIC_RELEASE);
+  __atomic_store_n(&completions.dequeuePosition, position + 1, __ATOMIC_SEQ_CST);
+  return TRUE;}
+#endif
+
+
+void deliverCompletions(void) {
+#ifdef UNIXISH
+  int index, delivered;
+
+
+  do {
+    if (__atomic_exchange_n(&completions.delivering, TRUE, __ATOMIC_SEQ_CST))
+      /* Someone else is delivering, and will see ours. */
+      return;
+
+    delivered = 0;
+    while (dequeueCompletion(&index)) {
+      /* Signals arriving from here on need another entry. */
+      if ((index >= 0) && (index < PendingSignalLimit))
+	__atomic_store_n(&completions.pending[index], FALSE, __ATOMIC_SEQ_CST);
+      vm->signalSemaphoreWithIndex(index);
+      delivered++;}
+    __atomic_store_n(&completions.delivering, FALSE, __ATOMIC_SEQ_CST);
+
+    /* The idle loop is woken without locking anything. */
+    if (delivered > 0) {
+      /* The VM may switch processes now; send what's been corked. */
+      uncorkSockets();
+      if (!wakeIdleLoop()) signalThread(&activity);}
+
+    /*
+     * Something may have been queued by a thread which saw us
+     * delivering, after we last looked.
+     */
+  } while (completionsQueued());
+#endif
+}
+
+
 void synchronizedSignalSemaphoreWithIndex(int index) {
+#ifdef UNIXISH
+  int tracked = (index >= 0) && (index < PendingSignalLimit);
+
+
+  if (tracked && __atomic_exchange_n(&completions.pending[index], TRUE, __ATOMIC_SEQ_CST)) {
+    /*
+     * The semaphore will be signalled anyway, after this event, by
+     * whoever delivers the queued signal.
+     */
+    __atomic_add_fetch(&completions.merged, 1, __ATOMIC_RELAXED);
+    return;}
+
+  if (queueCompletion(index)) {
+    deliverCompletions();
+    return;}
+
+  if (tracked)
+    __atomic_store_n(&completions.pending[index], FALSE, __ATOMIC_SEQ_CST);
+#endif
+
+  /* The queue is full; deliver this one directly. */
   vm->signalSemaphoreWithIndex(index);
-  signalThread(&activity);}
+  if (!wakeIdleLoop()) signalThread(&activity);}
+
+
+void signalThreadOperation(thread *operation) {
+  /* Note when, so the VM's eventual response can be timed. */
+
+  __atomic_store_n(&operation->signalledAt, monotonicMicroseconds(), __ATOMIC_RELAXED);
+  synchronizedSignalSemaphoreWithIndex(operation->sync.semaphore);}
 
 
 void stopIP(void) {
@@ -425,6 +900,135 @@ void associateNetResourceWithReadabilityIndexAndWritabilityIndex(void) {
   vm->pop(3);}
 
 
+void useReactorThreads(void) {
+  /* useReactorThreads: numberOfThreads */
+
+  /*
+   * With a positive number of threads, TCP sockets enabled from
+   * now on are watched by the shared epoll reactor, rather than
+   * by two scribing threads each. Zero restores scribing threads
+   * for new sockets; existing sockets keep their model.
+   */
+
+  int numberOfThreads = vm->stackIntegerValue(0);
+
+
+  if (!(vm->failed())) {
+    if (numberOfThreads <= 0)
+      readinessModel = scribingThreadsModel;
+    else {
+      if (!startReactor(numberOfThreads)) {
+	vm->primitiveFail();
+	return;}
+      readinessModel = reactorModel;}
+
+    vm->pop(1);}}
+
+
+void useCompletionRingEntries(void) {
+  /* useCompletionRingEntries: numberOfEntries */
+
+  /*
+   * With a positive number of entries, TCP sockets enabled from
+   * now on receive and send through a shared io_uring: a read
+   * notification queues the receive itself, into a native buffer,
+   * and a send is copied out and queued, so the data primitives
+   * make no system calls. Zero restores scribing threads for new
+   * sockets; existing sockets keep their model.
+   */
+
+  int numberOfEntries = vm->stackIntegerValue(0);
+
+
+  if (!(vm->failed())) {
+    if (numberOfEntries <= 0)
+      readinessModel = scribingThreadsModel;
+    else {
+      if (!startCompletionRing(numberOfEntries)) {
+	vm->primitiveFail();
+	return;}
+      readinessModel = completionRingModel;}
+
+    vm->pop(1);}}
+
+
+void usePooledWorkersUpTo(void) {
+  /*
+   * usePooledWorkers: numberOfWorkers
+   * upTo: maximumWorkers
+   */
+
+  /*
+   * With a positive number of workers, TCP sockets enabled from now
+   * on borrow threads from a shared pool for each wait, rather
+   * than creating two scribing threads each. The pool starts with
+   * at least the given number of workers, and grows as needed up
+   * to the maximum; past that, waits queue until a worker is free,
+   * so the maximum should exceed the number of sockets expected to
+   * wait without a timeout at once. Zero restores scribing threads
+   * for new sockets; existing sockets keep their model.
+   */
+
+  int numberOfWorkers = vm->stackIntegerValue(1);
+  int maximumWorkers = vm->stackIntegerValue(0);
+
+
+  if (!(vm->failed())) {
+    if (numberOfWorkers <= 0)
+      readinessModel = scribingThreadsModel;
+    else {
+      if ((maximumWorkers < numberOfWorkers)
+	  || !startWorkerPool(
+			      numberOfWorkers,
+			      maximumWorkers)) {
+	vm->primitiveFail();
+	return;}
+      readinessModel = pooledWorkersModel;}
+
+    vm->pop(2);}}
+
+
+void relinquishInEventLoop(void) {
+  /* relinquishInEventLoop: aBoolean */
+
+  /*
+   * When true, relinquishPhysicalProcessor waits in epoll_wait(),
+   * on the reactor's and completion ring's descriptors as well as
+   * an eventfd, rather than on the activity condition variable.
+   * I/O ready while the VM is idle is handled on the VM thread.
+   */
+
+  int enabled = vm->stackValue(0);
+
+
+  if (enabled == vm->trueObject()) {
+    if (!startIdleLoop()) {
+      vm->primitiveFail();
+      return;}}
+  else if (enabled == vm->falseObject())
+    stopIdleLoop();
+  else {
+    vm->primitiveFail();
+    return;}
+
+  vm->pop(1);}
+
+
+void mergedSemaphoreSignals(void) {
+  /*
+   * Answer how many semaphore signals from I/O threads were merged
+   * into signals already waiting for delivery to the VM.
+   */
+
+  unsigned int merged = 0;
+
+
+#ifdef UNIXISH
+  merged = __atomic_load_n(&completions.merged, __ATOMIC_RELAXED);
+#endif
+  vm->popthenPush(1, vm->positive32BitIntegerFor(merged));}
+
+
 void associateWithReadabilityIndexAndWritabilityIndex(void) {
   associateNetResourceWithReadabilityIndexAndWritabilityIndex();}
 
@@ -555,10 +1159,6 @@ void relinquishPhysicalProcessor(void) {
   int	          nextWakeupTick = vm->getNextWakeupTick();
   int	          now = (vm->ioMicroMSecs() & 0x1fffffff);
   int	          timeoutInMilliseconds;
-#ifdef UNIXISH
-  struct timeval  currentTime;
-  struct timespec wakeupTime;
-#endif
 
   if (nextWakeupTick <= now) {
     if (nextWakeupTick == 0)
@@ -579,20 +1179,19 @@ void relinquishPhysicalProcessor(void) {
   else
     timeoutInMilliseconds = nextWakeupTick - now;
 
+  /* The VM has done all it can for now; send what's been corked. */
+  uncorkSockets();
+
+  if (waitInIdleLoop(timeoutInMilliseconds)) {
+    deliverCompletions();
+    vm->setInterruptCheckCounter(0);
+    return;}
+
 #ifdef UNIXISH
 #if 1
-  pthread_mutex_lock(&activity.mutex);
-  gettimeofday(&currentTime, NULL);
-  wakeupTime.tv_nsec = (currentTime.tv_usec * 1000) + (timeoutInMilliseconds * 1000000);
-  wakeupTime.tv_sec = currentTime.tv_sec + (wakeupTime.tv_nsec / 1000000000);
-  wakeupTime.tv_nsec %= 1000000000;
-
-  pthread_cond_timedwait(
-			 &activity.request,
-			 &activity.mutex,
-			 &wakeupTime);
-
-  pthread_mutex_unlock(&activity.mutex);
+  waitForThreadSignalFor(&activity, timeoutInMilliseconds);
+  /* Collect anything a delivering thread left behind. */
+  deliverCompletions();
 #endif
 #if 0
   /*
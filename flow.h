@@ -22,6 +22,11 @@
 
 /* included headers */
 
+#if ((defined __linux__) && !(defined _GNU_SOURCE))
+/* for accept4(), and the other Linux-specific socket calls */
+#define _GNU_SOURCE
+#endif
+
 #ifdef _WIN32_WCE
 typedef unsigned int size_t;
 /* default EXPORT macro that does nothing (see comment in sq.h) */
@@ -53,17 +58,49 @@ typedef unsigned int size_t;
 #define UNIXISH
 #endif
 
+#if ((defined UNIXISH) && (defined __linux__))
+#define LINUXISH
+#endif
+
 #ifdef UNIXISH
 #include <stdio.h>
 #include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ioctl.h>
+#include <fcntl.h>
 #include <sys/time.h>
 #include <errno.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/tcp.h>
+#include <time.h>
+#endif
+
+#if ((defined UNIXISH) && (defined DEFLATE))
+#include <zlib.h>
+#endif
+
+#if ((defined UNIXISH) && (defined LZ4))
+#include <lz4frame.h>
+#endif
+
+#ifdef LINUXISH
+#include <stdint.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <poll.h>
+#include <linux/io_uring.h>
+#include <linux/futex.h>
+#include <netinet/udp.h>
+#include <linux/errqueue.h>
+#include <sys/sendfile.h>
+#include <linux/filter.h>
 #endif
 
 // #include <phidget21.h>
@@ -121,6 +158,10 @@ typedef unsigned int size_t;
 #define close(socket)		    closesocket(socket)
 #endif
 
+/* whether a call which answered result failed only because it would have blocked */
+#define wouldHaveBlocked(result)    (((result) == -1) \
+				     && ((lastError() == EWOULDBLOCK) || (lastError() == EAGAIN)))
+
 /* speech */
 
 #define SPEECH_SESSION_ID	    42
@@ -142,6 +183,91 @@ typedef unsigned int size_t;
 #define PitchWheel		    0xE0
 #define System			    0xF0
 
+/* threads */
+
+#define ThreadRequestRingSize	    8
+#define CompletionQueueSize	    4096
+#define PendingSignalLimit	    65536
+
+/* reactor */
+
+#define ReactorEventBatchSize	    256
+
+/* completion ring */
+
+#define RingReceiveBufferSize	    65536
+
+/* socket queues */
+
+#define ReceiveQueueInitialSize	    65536
+#define ReceiveQueueLimit	    16777216
+#define SendQueueLimit		    16777216
+
+/* how often a draining writing thread looks for new requests, in milliseconds */
+#define SendQueueDrainInterval	    50
+
+/* the longest delimiter for delimited frames */
+#define FrameDelimiterLimit	    16
+
+/* compression: the most bytes compressed at once, and received at once for decompression */
+#define CompressionChunkSize	    65536
+
+/* the most sockets auto-corked at once (see ip.c) */
+#define AutoCorkLimit		    256
+
+/* selectors */
+
+#define SelectorBatchSize	    256
+/* interest and readiness, as bits */
+#define SelectorReadable	    1
+#define SelectorWritable	    2
+#define SelectorHungUp		    4
+
+/*
+ * zero-copy sends: the smallest send worth the kernel's page pinning
+ * (smaller ones are copied, as usual), how many may be in flight per
+ * socket, and how many completion events the reaper takes at once
+ */
+
+#define ZeroCopyThreshold	    65536
+#define ZeroCopySendLimit	    256
+#define ZeroCopyEventBatchSize	    64
+
+/* proxies: the most bytes moved by one splice() or sendfile() */
+
+#define ProxyChunkSize		    65536
+
+/*
+ * pipelines: the most bytes read from a source at once (each buffer
+ * has twice that, for stages which add to their input), and the most
+ * stages one pipeline may have
+ */
+
+#define PipelineChunkSize	    65536
+#define PipelineStageLimit	    8
+
+/* resolvers */
+
+#define ResolverPoolSize	    4
+#define ResolutionCacheBuckets	    256
+#define ResolutionCacheCapacity	    4096
+#define ResolutionLifetime	    60000
+#define FailedResolutionLifetime    5000
+
+/* vectored I/O: the most ByteArray regions one primitive call may use */
+
+#define MaximumVectorLength	    64
+
+/*
+ * batched UDP: the most datagrams per primitive call, and the size
+ * of the length and address which precede each one received, or
+ * describe each one sent
+ */
+
+#define MaximumPacketBatch	    64
+#define ReceivedPacketHeaderSize    12
+#define PacketDescriptorSize	    16
+
 
 /*
  * simple types
@@ -169,7 +295,10 @@ enum {
   flowConnect = 2001,
   flowAccept,
   flowRead,
-  flowWrite};
+  flowWrite,
+
+  /* internal: a writing thread should drain the socket's send queue */
+  flowDrain};
 
 /* resource operation results */
 enum {
@@ -191,6 +320,54 @@ enum {
   noClobber,
   clobber};
 
+/* how received data is divided into frames */
+enum {
+  unframed = 7001,
+  lengthPrefixed,
+  delimited};
+
+/* pipeline stages */
+enum {
+  checksumStage = 8001,
+  rateLimitStage,
+  framingStage,
+  compressionStage,
+  decompressionStage};
+
+/* compression codecs */
+enum {
+  deflateCodec = 9001,
+  lz4Codec};
+
+/* when a compressor writes out what it has (for internal use) */
+enum {
+  codecContinue = 10001,
+  codecFlush,
+  codecFinish};
+
+/* how connections are steered among listeners sharing a port */
+enum {
+  cpuSteering = 11001,
+  hashSteering};
+
+/* per-socket TCP options */
+enum {
+  noDelayOption = 12001,
+  corkOption,
+  autoCorkOption,
+  quickAckOption,
+  sendBufferSizeOption,
+  receiveBufferSizeOption,
+  fastOpenOption,
+  fastOpenConnectOption};
+
+/* readiness notification models */
+enum {
+  scribingThreadsModel = 6001,
+  reactorModel,
+  completionRingModel,
+  pooledWorkersModel};
+
 
 /*
  * structures
@@ -205,6 +382,7 @@ typedef struct {
   int             semaphore;
 #ifdef UNIXISH
   pthread_t	  thread;
+  /* On Linux, a futex word, and the mutex and condition go unused. */
   int		  requestAlreadyOccurred;
   pthread_cond_t  request;
   pthread_mutex_t mutex;
@@ -219,22 +397,477 @@ typedef struct {
   char		 addressBytes[4], *hostname;
   struct in_addr address;
   threadSync	 sync;
+
+  /*
+   * queued or being resolved by the shared pool, and whether the
+   * latest hostname was answered from the cache meanwhile
+   */
+  int		 busy, answered;
 }                resolver;
 
+typedef struct resolution {
+  char		    *hostname;
+  char		    addressBytes[4];
+  int		    found;
+  long long	    expiry;
+  struct resolution *next;
+}		    resolution;
+
+#ifdef UNIXISH
 typedef struct {
-  int	     operation, timeout, result;
-  threadSync sync;
-}	     thread;
+  int		  running, numberOfWorkers;
+  threadSync	  workers[ResolverPoolSize];
+  pthread_mutex_t mutex;
+  pthread_cond_t  requestsPending;
+
+  /* queued resolvers, as a circular buffer */
+  resolver	  **requests;
+  int		  firstRequest, numberOfRequests, requestCapacity;
+
+  /* recent resolutions and failures, by hostname */
+  resolution	  *cache[ResolutionCacheBuckets];
+  int		  numberOfResolutions, lifetime, failureLifetime;
+}		  resolverPool;
+#endif
+
+typedef struct {
+  int operation, timeout;
+}     threadRequest;
+
+typedef struct {
+  int		operation, timeout, result;
+  threadSync	sync;
+
+  /*
+   * requests from the VM thread to a scribing thread, as a
+   * single-producer, single-consumer ring
+   */
+  threadRequest requests[ThreadRequestRingSize];
+  unsigned int	firstRequest, requestLimit;
+
+  /* reactor bookkeeping */
+  int		armed, deadlineIndex;
+  long long	deadline;
+
+  /*
+   * low-latency mode: how many microseconds to poll before blocking
+   * (none when zero), and how often polling found what it wanted,
+   * counted separately for socket readiness and for requests from
+   * the VM thread
+   */
+  int		spinBudget;
+  unsigned int	spinsSatisfied, spinsExhausted;
+  unsigned int	requestSpinsSatisfied, requestSpinsExhausted;
+
+  /*
+   * when the operation's semaphore was last signalled, in monotonic
+   * microseconds (zero once the VM has acted on it)
+   */
+  long long	signalledAt;
+}		thread;
 	
 typedef struct {
   int	     handle;
   thread     reading, writing;
+  int	     model, reactorSlot;
+
+  /* the resource's ringChannel, in the completion ring model */
+  void	     *channel;
+
+  /* data received ahead of the VM's requests, if enabled */
+  void	     *receiveQueue;
+
+  /* data accepted from the VM but not yet sent, if enabled */
+  void	     *sendQueue;
+
+  /* zero-copy sends in flight, if enabled */
+  void	     *zeroCopy;
 }	     netResource;
 
 typedef struct {
-  netResource resource;
-  int	      state, transport;
-}	      flowSocket;
+  netResource	     resource;
+  int		     state, transport;
+
+  /*
+   * instrumentation, kept by the VM's thread: bytes moved, calls of
+   * the reading and writing primitives, how many found nothing to
+   * do, readiness waits requested, and the total delay from
+   * readiness signals to the calls that followed them
+   */
+  unsigned long long bytesIn, bytesOut, signalDelay;
+  unsigned int	     calls, wouldBlocks, waits, signalsTaken;
+
+  /* whether autoCorkOption is set, and whether it has corked the socket */
+  int		     autoCork, corked;
+}		     flowSocket;
+
+
+/* completions, from any thread to the VM */
+
+#ifdef UNIXISH
+typedef struct {
+  unsigned int sequence;
+  int	       semaphoreIndex;
+}	       completion;
+
+typedef struct {
+  /* a bounded multiple-producer, single-consumer queue */
+  completion   entries[CompletionQueueSize];
+  unsigned int enqueuePosition, dequeuePosition;
+
+  /* set while some thread is delivering queued completions to the VM */
+  int	       delivering;
+
+  /*
+   * For each semaphore index, whether a signal for it is already
+   * queued. Further signals are merged into that one, and counted.
+   */
+  unsigned char pending[PendingSignalLimit];
+  unsigned int merged;
+}	       completionQueue;
+
+/* compression */
+
+typedef struct {
+  int		     kind, compressing;
+
+  /* whether a compressor has begun its stream, and has finished it */
+  int		     started, finished;
+
+#ifdef DEFLATE
+  z_stream	     zlib;
+#endif
+#ifdef LZ4
+  LZ4F_preferences_t lz4Preferences;
+  LZ4F_cctx	     *lz4Compression;
+  LZ4F_dctx	     *lz4Decompression;
+#endif
+
+  /*
+   * Compressors flush after this many bytes of input have arrived
+   * since the last flush, or after every write if it's zero.
+   */
+  int		     flushEvery, sinceFlush;
+
+  /* output space, big enough for a compressed chunk */
+  char		     *scratch;
+  int		     scratchSize;
+
+  /* for sockets' decompressors, received bytes not yet decompressed */
+  char		     *pending;
+  int		     pendingStart, pendingCount;
+
+  /* bytes taken and given, and the CPU time spent, in nanoseconds */
+  unsigned long long bytesIn, bytesOut, nanoseconds;
+}		     codec;
+
+/* socket queues */
+
+typedef struct {
+  /* a ring of received bytes, grown as needed up to ReceiveQueueLimit */
+  char		  *bytes;
+  int		  capacity, start, count;
+
+  /*
+   * The readability semaphore is signalled once this many bytes are
+   * queued, or this many milliseconds after the first byte arrived.
+   */
+  int		  lowWatermark, flushTimeout;
+
+  /*
+   * With framing, readability is signalled instead once a whole
+   * frame is queued. A length-prefixed frame is a fixed-size header,
+   * with a big- or little-endian length field somewhere in it, then
+   * that many bytes. A delimited frame ends with the delimiter.
+   */
+  int		  framing;
+  int		  headerSize, lengthOffset, lengthWidth, bigEndian;
+  char		  delimiter[FrameDelimiterLimit];
+  int		  delimiterSize;
+
+  /* how many queued bytes have been searched for a delimiter already */
+  int		  scanned;
+
+  /* Received bytes are decompressed on their way into the ring, if there is one. */
+  codec		  *decompressor;
+
+  int		  ended, error;
+  pthread_mutex_t mutex;
+}		  receiveQueue;
+
+typedef struct {
+  /* a ring of bytes to send, as big as the high watermark */
+  char		  *bytes;
+  int		  capacity, start, count;
+
+  /*
+   * The VM may queue bytes until the high watermark is reached. The
+   * writability semaphore is signalled once the queue has drained to
+   * the low watermark.
+   */
+  int		  highWatermark, lowWatermark;
+
+  /*
+   * Bytes are compressed on their way into the ring, if there is one;
+   * the watermarks then count compressed bytes.
+   */
+  codec		  *compressor;
+
+  int		  error;
+  pthread_mutex_t mutex;
+}		  sendQueue;
+#endif
+
+
+/* reactor */
+
+#ifdef LINUXISH
+typedef struct {
+  long long   when;
+  thread      *operation;
+  netResource *resource;
+}	      reactorDeadline;
+
+typedef struct {
+  int		  epoll, wakeup, running;
+  int		  numberOfThreads;
+  threadSync	  *threads;
+  pthread_mutex_t mutex;
+
+  /* registered resources, indexed by slot */
+  netResource	  **resources;
+  unsigned int	  *generations;
+  int		  *freeSlots;
+  int		  numberOfSlots, numberOfFreeSlots;
+
+  /* armed operations with timeouts, as a binary min-heap */
+  reactorDeadline *deadlines;
+  int		  numberOfDeadlines, deadlineCapacity;
+}		  reactor;
+
+typedef struct {
+  int	       enabled, epoll, wakeup;
+
+  /* the reactor and completion ring descriptors being watched, or -1 */
+  int	       watchedReactor, watchedRing;
+
+  /*
+   * wake requests since the VM last idled, and whether it is idling
+   * now; accessed atomically, without locks
+   */
+  unsigned int wakeRequests, lastSeenWakeRequests;
+  int	       idle;
+}	       idleLoop;
+
+
+/* completion ring */
+
+typedef struct {
+  /* NULL once the resource has closed; freed when nothing is in flight */
+  netResource		   *resource;
+  int			   handle, inFlight;
+
+  /* receiving */
+  char			   *receiveBuffer;
+  int			   receiveStart, receiveStop, receiving, receiveEnded, receiveError;
+  struct __kernel_timespec receiveTimeout;
+
+  /* sending */
+  char			   *sendBuffer;
+  int			   sendCapacity, sendStart, sendStop, sending, sendError;
+  long long		   writeDeadline;
+  struct __kernel_timespec writeTimeout;
+}			   ringChannel;
+
+typedef struct {
+  int		      descriptor, running;
+  unsigned int	      entries, submissionTail;
+  threadSync	      reaper;
+  pthread_mutex_t     mutex;
+
+  /* the shared rings, mapped from the kernel */
+  void		      *submissionRing, *completionRing;
+  size_t	      submissionRingSize, completionRingSize, entriesSize;
+  unsigned int	      *submissionHead, *submissionTailPointer, *submissionMask, *submissionArray;
+  unsigned int	      *completionHead, *completionTail, *completionMask;
+  struct io_uring_sqe *submissions;
+  struct io_uring_cqe *completions;
+}		      completionRing;
+
+/* pooled workers */
+
+typedef struct {
+  netResource *resource;
+  thread      *operation;
+}	      workerJob;
+
+typedef struct {
+  threadSync  sync;
+
+  /* an eventfd, written to interrupt the worker's current wait */
+  int	      cancellation;
+
+  /* what the worker is waiting for, if anything */
+  workerJob   job;
+  int	      cancelled;
+}	      poolWorker;
+
+typedef struct {
+  int		  running;
+  pthread_mutex_t mutex;
+  pthread_cond_t  jobsPending, jobFinished;
+
+  /* Workers are never moved, since their threads refer to them. */
+  poolWorker	  **workers;
+  int		  numberOfWorkers, workerCapacity, idleWorkers;
+
+  /* how many workers the pool may grow to */
+  int		  maximumWorkers;
+
+  /* a circular queue of armed operations not yet taken by a worker */
+  workerJob	  *jobs;
+  int		  firstJob, numberOfJobs, jobCapacity;
+}		  workerPool;
+
+/* selectors */
+
+typedef struct {
+  /* an epoll descriptor, and an eventfd for waking its thread */
+  int		     handle, wakeup, closing;
+
+  /* The semaphore is signalled when sockets are ready. */
+  threadSync	     sync;
+
+  /*
+   * Sockets found ready, not yet all taken by the VM. The selector
+   * thread only refills the list once it's empty.
+   */
+  struct epoll_event ready[SelectorBatchSize];
+  int		     numberOfReady, firstReady;
+}		     selector;
+
+/* zero-copy sends */
+
+typedef struct {
+  /* native memory, so the garbage collector can't move it mid-send */
+  char *bytes;
+  int  size;
+
+  /*
+   * zero-copy sends from the buffer which the kernel hasn't finished
+   * with; the semaphore is signalled when there are none left
+   */
+  int  inFlight, semaphore;
+}      sendBuffer;
+
+typedef struct {
+  unsigned int sequence;
+  sendBuffer   *buffer;
+  int	       done;
+}	       zeroCopySend;
+
+typedef struct zeroCopySends {
+  int		       handle;
+
+  /* The kernel numbers each socket's zero-copy sends from zero. */
+  unsigned int	       nextSequence;
+  zeroCopySend	       sends[ZeroCopySendLimit];
+  int		       firstSend, numberOfSends;
+
+  /* how many sends have completed, and how many of those the kernel copied anyway */
+  unsigned int	       completed, copied;
+
+  /*
+   * Once its socket is closed, the reaper may still have an event
+   * for it; it's freed after the reaper's next batch of events.
+   */
+  int		       released;
+  struct zeroCopySends *nextReleased;
+}		       zeroCopySends;
+
+typedef struct {
+  /* an epoll descriptor watching sockets' error queues, and an eventfd for stopping */
+  int		  epoll, wakeup, running;
+  threadSync	  sync;
+
+  /* held while completions are read, and while sockets are forgotten */
+  pthread_mutex_t mutex;
+  zeroCopySends	  *released;
+}		  zeroCopyReaper;
+
+/* proxies */
+
+typedef struct {
+  /* The semaphore is signalled when the source ends, or moving fails. */
+  threadSync	     sync;
+
+  /* descriptors, with a pipe between sockets, and an eventfd for stopping */
+  int		     source, destination, pipe[2], wakeup;
+  int		     sourceIsFile, running;
+
+  /* for files, where to send from, and how much is left to send */
+  off_t		     offset;
+  long long	     remaining;
+
+  /*
+   * bytes moved so far, then the outcome (zero until there is one)
+   * and any error number; accessed atomically
+   */
+  unsigned long long moved;
+  int		     result, errorNumber;
+}		     proxy;
+
+/* pipelines */
+
+typedef struct {
+  int		     kind;
+
+  /* checksum stages: the CRC-32 of every byte so far; accessed atomically */
+  unsigned int	     checksum;
+
+  /* rate-limiting stages: when the next bytes may pass, in monotonic microseconds */
+  int		     bytesPerSecond;
+  long long	     nextRelease;
+
+  /* framing stages: the width of each frame's length prefix, and its byte order */
+  int		     lengthWidth, bigEndian;
+
+  /* compression and decompression stages */
+  codec		     *codec;
+
+  /* Stages which change bytes write them here; others pass their input on. */
+  char		     *output;
+  int		     outputSize;
+}		     pipelineStage;
+
+typedef struct {
+  /* The semaphore is signalled when the source ends, or moving fails. */
+  threadSync	     sync;
+
+  /* descriptors, with an eventfd for stopping */
+  int		     source, destination, wakeup;
+  int		     sourceIsFile, running;
+
+  /* for file sources, where to read from next */
+  off_t		     offset;
+
+  /* the stages, in the order bytes pass through them */
+  pipelineStage	     stages[PipelineStageLimit];
+  int		     numberOfStages;
+
+  /* where bytes are read from the source, and the most read at once */
+  char		     *input;
+  int		     chunkSize;
+
+  /*
+   * bytes read from the source and written to the destination so far,
+   * then the outcome (zero until there is one) and any error number;
+   * accessed atomically
+   */
+  unsigned long long bytesIn, bytesOut;
+  int		     result, errorNumber;
+}		     pipeline;
+#endif
 
 
 /* phidgets */
@@ -457,14 +1090,125 @@ int	           startScribingThreads(
 					void *readingFunction,
 					void *parameter);
 void	           waitForThreadSignal(threadSync *sync);
+void	           waitForThreadSignalFor(
+					  threadSync *sync,
+					  int milliseconds);
 void	           signalThread(threadSync *sync);
-void	           signalSynchronizedResourceThread(thread *thread);
+void	           waitForThreadRequest(thread *thread);
+int	           signalSynchronizedResourceThread(thread *thread);
+int	           postThreadRequest(
+				     thread *thread,
+				     int operation,
+				     int timeout);
+int	           notifySynchronizedResource(
+					      netResource *resource,
+					      thread *thread);
+void	           stopScribing(netResource *resource);
+void	           synchronizedSignalSemaphoreWithIndex(int index);
+void	           signalThreadOperation(thread *operation);
+void	           countTransfer(
+				 flowSocket *socketPointer,
+				 thread *operation,
+				 int moved,
+				 int wouldBlock);
+void	           deliverCompletions(void);
 void	           stopThread(threadSync *sync);
 void	           killThread(threadSync *sync);
 void	           stopIP(void);
+int	           startResolverPool(void);
+void	           stopResolverPool(void);
 void	           startMIDI(void);
 void	           stopMIDI(void);
 void	           closeMIDIPort(int portIndex);
+long long	   monotonicMilliseconds(void);
+long long	   monotonicMicroseconds(void);
+int	           connectionResult(int socket);
+void	           uncorkSockets(void);
+int	           startReactor(int numberOfThreads);
+void	           stopReactor(void);
+int	           registerWithReactor(netResource *resource);
+int	           armReactorOperation(
+				       netResource *resource,
+				       thread *operation);
+void	           unregisterFromReactor(netResource *resource);
+int	           reactorDescriptor(void);
+void	           serviceReactor(void);
+int	           startIdleLoop(void);
+void	           stopIdleLoop(void);
+int	           wakeIdleLoop(void);
+int	           waitInIdleLoop(int milliseconds);
+void	           forgetIdleLoopDescriptor(int descriptor);
+int	           replaceResourceHandle(
+					 netResource *resource,
+					 int handle);
+int	           startCompletionRing(int entries);
+void	           stopCompletionRing(void);
+int	           attachToCompletionRing(netResource *resource);
+int	           armRingOperation(
+				    netResource *resource,
+				    thread *operation);
+int	           takeReceivedBytes(
+				     netResource *resource,
+				     char *target,
+				     int count);
+int	           queueSend(
+			     netResource *resource,
+			     char *source,
+			     int count);
+void	           detachFromCompletionRing(netResource *resource);
+int	           completionRingDescriptor(void);
+void	           serviceCompletionRing(void);
+int	           startWorkerPool(
+				   int numberOfWorkers,
+				   int maximumWorkers);
+void	           stopWorkerPool(void);
+int	           armPooledOperation(
+				      netResource *resource,
+				      thread *operation);
+void	           releasePooledResource(netResource *resource);
+int	           fillReceiveQueue(
+				    netResource *resource,
+				    int timeout);
+int	           takeQueuedBytes(
+				   netResource *resource,
+				   char *target,
+				   int count);
+int	           queuedByteCount(netResource *resource);
+int	           drainSendQueue(
+				  netResource *resource,
+				  int target,
+				  int timeout);
+int	           queueBytesToSend(
+				    netResource *resource,
+				    char *source,
+				    int count);
+void	           releaseQueues(netResource *resource);
+int	           flushSendQueueCompression(netResource *resource);
+#ifdef UNIXISH
+codec	           *newCodec(
+			     int kind,
+			     int compressing,
+			     int level);
+int	           runCodec(
+			    codec *codecPointer,
+			    char **input,
+			    int *inputCount,
+			    char *output,
+			    int outputSize,
+			    int flush);
+int	           codecBound(
+			      codec *codecPointer,
+			      int count);
+void	           freeCodec(codec *codecPointer);
+#endif
+void	           releaseZeroCopy(netResource *resource);
+void	           stopZeroCopyReaper(void);
+int	           waitUnlessWoken(
+				   int descriptor,
+				   short events,
+				   int wakeup,
+				   int milliseconds);
+int	           proxiedSocketUsable(flowSocket *socketPointer);
 
 /* for external use */
 #ifdef WIN32
@@ -485,6 +1229,11 @@ EXPORT(void)	   clearMarkOnBehavior(void);
 EXPORT(void)	   compiledMethodIsMarked(void);
 EXPORT(void)	   clearMarkOnCompiledMethod(void);
 EXPORT(void)	   relinquishPhysicalProcessor(void);
+EXPORT(void)	   useReactorThreads(void);
+EXPORT(void)	   useCompletionRingEntries(void);
+EXPORT(void)	   usePooledWorkersUpTo(void);
+EXPORT(void)	   relinquishInEventLoop(void);
+EXPORT(void)	   mergedSemaphoreSignals(void);
 
 /* from ip.c */
 EXPORT(void)	   newResolverHandleInto(void);
@@ -494,25 +1243,97 @@ EXPORT(void)	   notifyAfterResolvingHostNamed(void);
 EXPORT(void)	   writeAddressBytesForResolverInto(void);
 EXPORT(void)	   nameForIPAddressInto(void);
 EXPORT(void)	   closeResolver(void);
+EXPORT(void)	   cacheResolutionsForAndFailuresFor(void);
 EXPORT(void)	   newSocketHandleInto(void);
 EXPORT(void)	   connectSocketToAddress(void);
 EXPORT(void)	   notifySocketWhenItMayPerformTimeoutAfter(void);
 EXPORT(void)	   bindSocketToPort(void);
 EXPORT(void)	   acceptFrom(void);
+EXPORT(void)	   acceptUpToFromInto(void);
 EXPORT(void)	   enableSocketUsingTCP(void);
 EXPORT(void)	   socketTimedOut(void);
 EXPORT(void)	   tcpSocketConnectionRefused(void);
 EXPORT(void)	   listenAtPortQueueSizeTCPSocket(void);
+EXPORT(void)	   listenAtPortQueueSizeSharedTCPSocket(void);
+EXPORT(void)	   steerConnectionsForTCPSocketByAmong(void);
+EXPORT(void)	   attachSteeringProgramToTCPSocket(void);
+EXPORT(void)	   setOptionForTCPSocketTo(void);
+EXPORT(void)	   optionForTCPSocket(void);
 EXPORT(void)	   peerAddressIntoNameIntoTCPSocket(void);
 EXPORT(void)	   dataAvailableForSocket(void);
 EXPORT(void)	   nextFromTCPSocketIntoStartingAt(void);
+EXPORT(void)	   nextVectorFromTCPSocketInto(void);
 EXPORT(void)	   nextPutFromToTCPSocketStartingAt(void);
+EXPORT(void)	   nextPutVectorToTCPSocket(void);
 EXPORT(void)	   tcpSocketIsActive(void);
+EXPORT(void)	   spinOnSocketForMicrosecondsBusyPolling(void);
+EXPORT(void)	   spinStatisticsForSocketInto(void);
+EXPORT(void)	   statisticsForTCPSocketInto(void);
 EXPORT(void)	   nextPacketFromUDPSocketInto(void);
 EXPORT(void)	   nextPacketFromUDPSocketIntoAddressInto(void);
 EXPORT(void)	   sendPacketFromUDPSocketToAddress(void);
+EXPORT(void)	   nextPacketFromUDPSocketIntoStartingAtCountAddressInto(void);
+EXPORT(void)	   sendPacketStartingAtCountFromUDPSocketToAddress(void);
+EXPORT(void)	   nextPacketsFromUDPSocketUpToInto(void);
+EXPORT(void)	   sendPacketsFromUDPSocketDescribedBy(void);
+EXPORT(void)	   sendPacketFromUDPSocketToAddressInSegmentsOf(void);
+EXPORT(void)	   coalescePacketsForUDPSocket(void);
+EXPORT(void)	   nextCoalescedPacketsFromUDPSocketIntoAddressIntoSegmentSizeInto(void);
 EXPORT(void)	   closeSocket(void);
 
+/* from queues.c */
+EXPORT(void)	   queueReceivedDataForTCPSocketLowWatermarkFlushAfter(void);
+EXPORT(void)	   queueSentDataForTCPSocketHighWatermarkLowWatermark(void);
+EXPORT(void)	   frameReceivedDataForTCPSocketHeaderSizeLengthAtWidthBigEndian(void);
+EXPORT(void)	   frameReceivedDataForTCPSocketDelimitedBy(void);
+EXPORT(void)	   nextFrameSizeForTCPSocket(void);
+EXPORT(void)	   nextFrameFromTCPSocketIntoStartingAt(void);
+
+/* from compression.c */
+EXPORT(void)	   compressSentDataForTCPSocketCodecLevelFlushEvery(void);
+EXPORT(void)	   decompressReceivedDataForTCPSocketCodec(void);
+EXPORT(void)	   flushCompressedDataForTCPSocket(void);
+EXPORT(void)	   compressionStatisticsForTCPSocketInto(void);
+
+/* from zerocopy.c */
+EXPORT(void)	   newSendBufferOfSizeInto(void);
+EXPORT(void)	   registerThatSendBufferHasReusabilityIndex(void);
+EXPORT(void)	   copyFromStartingAtIntoSendBufferAt(void);
+EXPORT(void)	   freeSendBuffer(void);
+EXPORT(void)	   enableZeroCopyForTCPSocket(void);
+EXPORT(void)	   nextPutFromSendBufferStartingAtToTCPSocket(void);
+EXPORT(void)	   zeroCopyStatisticsForSocketInto(void);
+
+/* from proxy.c */
+EXPORT(void)	   newProxyHandleInto(void);
+EXPORT(void)	   registerThatProxyHasCompletionIndex(void);
+EXPORT(void)	   proxyFromTCPSocketToTCPSocket(void);
+EXPORT(void)	   proxyFromFileStartingAtCountToTCPSocket(void);
+EXPORT(void)	   statisticsForProxyInto(void);
+EXPORT(void)	   closeProxy(void);
+
+/* from pipeline.c */
+EXPORT(void)	   newPipelineHandleInto(void);
+EXPORT(void)	   registerThatPipelineHasCompletionIndex(void);
+EXPORT(void)	   addChecksumStageToPipeline(void);
+EXPORT(void)	   addRateLimitStageToPipelineBytesPerSecond(void);
+EXPORT(void)	   addFramingStageToPipelineLengthWidthBigEndian(void);
+EXPORT(void)	   addCompressionStageToPipelineCodecLevelFlushEvery(void);
+EXPORT(void)	   addDecompressionStageToPipelineCodec(void);
+EXPORT(void)	   startPipelineFromTCPSocketToTCPSocket(void);
+EXPORT(void)	   startPipelineFromFileStartingAtToTCPSocket(void);
+EXPORT(void)	   startPipelineFromTCPSocketToFile(void);
+EXPORT(void)	   statisticsForPipelineInto(void);
+EXPORT(void)	   closePipeline(void);
+
+/* from selector.c */
+EXPORT(void)	   newSelectorHandleInto(void);
+EXPORT(void)	   registerThatSelectorHasReadinessIndex(void);
+EXPORT(void)	   enableSelector(void);
+EXPORT(void)	   watchSocketWithSelectorFor(void);
+EXPORT(void)	   readySocketsFromSelectorInto(void);
+EXPORT(void)	   closeSelector(void);
+
 /* See ViaVoice comment above. */
 /* from speech.c */
 #ifdef VIAVOICE
@@ -11,12 +11,105 @@
 
 #include "flow.h"
 extern struct VirtualMachine *vm;
+extern int		     readinessModel;
 
 
 /*
  * utilities
  */
 
+/*
+ * Sockets with autoCorkOption set are corked by their first write
+ * after each boundary, and uncorked at the next. The boundaries are
+ * where the writing Smalltalk process's burst has evidently ended:
+ * when it waits for a socket, when signals are delivered to the VM
+ * (which may switch processes), and when the VM relinquishes the
+ * processor. Signals are delivered from any thread, so the corked
+ * sockets are guarded by a mutex.
+ */
+static flowSocket      *corkedSockets[AutoCorkLimit];
+static int	       corkedSocketCount = 0;
+#ifdef TCP_CORK
+static pthread_mutex_t corkedSocketsMutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+static void setCork(
+		    flowSocket *socketPointer,
+		    int	       corked) {
+#ifdef TCP_CORK
+  setsockopt(
+	     socketPointer->resource.handle,
+	     IPPROTO_TCP,
+	     TCP_CORK,
+	     &corked,
+	     sizeof(corked));
+#endif
+}
+
+
+#ifdef TCP_CORK
+static void uncorkLockedSockets(void) {
+  flowSocket *socketPointer;
+
+
+  while (corkedSocketCount > 0) {
+    socketPointer = corkedSockets[--corkedSocketCount];
+    setCork(socketPointer, FALSE);
+    __atomic_store_n(&socketPointer->corked, FALSE, __ATOMIC_RELAXED);}}
+#endif
+
+
+void uncorkSockets(void) {
+  /* At a boundary, send whatever the auto-corked sockets have held back. */
+
+#ifdef TCP_CORK
+  if (__atomic_load_n(&corkedSocketCount, __ATOMIC_RELAXED) == 0) return;
+
+  pthread_mutex_lock(&corkedSocketsMutex);
+  uncorkLockedSockets();
+  pthread_mutex_unlock(&corkedSocketsMutex);
+#endif
+}
+
+
+static void forgetCorkedSocket(flowSocket *socketPointer) {
+  /* Do this before the socket is closed or freed. */
+
+#ifdef TCP_CORK
+  int index;
+
+
+  pthread_mutex_lock(&corkedSocketsMutex);
+  for (index = 0; index < corkedSocketCount; index++)
+    if (corkedSockets[index] == socketPointer) {
+      corkedSockets[index] = corkedSockets[--corkedSocketCount];
+      break;}
+  socketPointer->corked = FALSE;
+  pthread_mutex_unlock(&corkedSocketsMutex);
+#endif
+}
+
+
+static void corkUntilBoundary(flowSocket *socketPointer) {
+  /* Cork an auto-corking socket before it's written to, if it isn't already. */
+
+#ifdef TCP_CORK
+  if (!socketPointer->autoCork
+      || __atomic_load_n(&socketPointer->corked, __ATOMIC_RELAXED))
+    return;
+
+  pthread_mutex_lock(&corkedSocketsMutex);
+  /* When too many are corked, the rest go early. */
+  if (corkedSocketCount == AutoCorkLimit) uncorkLockedSockets();
+  setCork(socketPointer, TRUE);
+  socketPointer->corked = TRUE;
+  corkedSockets[corkedSocketCount++] = socketPointer;
+  pthread_mutex_unlock(&corkedSocketsMutex);
+#endif
+}
+
+
 int socketClosed(flowSocket *socketPointer) {
   char buffer;
   int  status,
@@ -25,6 +118,9 @@ int socketClosed(flowSocket *socketPointer) {
 
   if (socketPointer->state == flowClosed)
     return TRUE;
+  else if (queuedByteCount(&socketPointer->resource) > 0)
+    /* Queued data may still be read, even if the peer has gone. */
+    return FALSE;
   else {
     /*
      * Check for socket closure, without consuming any data that might
@@ -38,8 +134,8 @@ int socketClosed(flowSocket *socketPointer) {
 
     if ((status == 0) || ((status == -1) && (lastError() == ECONNRESET))) {
       socketPointer->state = flowClosed;
-      killThread(&socketPointer->resource.reading.sync);
-      killThread(&socketPointer->resource.writing.sync);
+      forgetCorkedSocket(socketPointer);
+      stopScribing(&socketPointer->resource);
       close(socketPointer->resource.handle);
       free((void *)socketPointer);
       closed = TRUE;}
@@ -48,35 +144,340 @@ int socketClosed(flowSocket *socketPointer) {
     return closed;}}
 
 
+int connectionResult(int socket) {
+  /*
+   * Answer whether a non-blocking connection attempt, which has
+   * finished, succeeded.
+   */
+
+  int	    status = 0;
+  socklen_t length = sizeof(status);
+
+
+  if (getsockopt(socket, SOL_SOCKET, SO_ERROR, &status, &length) < 0)
+    return error;
+  else return status ? failedConnection : successfulConnection;}
+
+
+int lookUpHost(
+	       char *hostname,
+	       char *addressBytes) {
+  /* Answer whether hostname has an IPv4 address, writing it if so. */
+
+  struct addrinfo hints,
+                  *results;
+
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(hostname, NULL, &hints, &results) != 0)
+    return FALSE;
+
+  memcpy(
+	 addressBytes,
+	 &((struct sockaddr_in *) results->ai_addr)->sin_addr,
+	 4);
+  freeaddrinfo(results);
+  return TRUE;}
+
+
+void finishResolution(
+		      resolver *resolverPointer,
+		      int      found,
+		      char     *addressBytes) {
+  resolverPointer->result = convertedInteger(found);
+  if (found)
+    memcpy(
+	   resolverPointer->addressBytes,
+	   addressBytes,
+	   4);
+  synchronizedSignalSemaphoreWithIndex(resolverPointer->sync.semaphore);}
+
+
+#ifdef UNIXISH
+/*
+ * Every resolver shares one small pool of worker threads, and a
+ * cache of recent resolutions (and failures), so that looking up
+ * the same hosts repeatedly doesn't keep going to the system
+ * resolver. getaddrinfo() reports no record lifetimes, so cached
+ * entries live for a configured time instead. Everything here is
+ * guarded by the pool's mutex.
+ */
+
+static resolverPool resolvers = {
+  FALSE, 0, {{0}}, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+  NULL, 0, 0, 0,
+  {NULL}, 0, ResolutionLifetime, FailedResolutionLifetime};
+
+
+static unsigned int hostnameHash(char *hostname) {
+  unsigned int hash = 2166136261U;
+
+
+  while (*hostname) {
+    hash ^= (unsigned char) *hostname++;
+    hash *= 16777619U;}
+
+  return hash % ResolutionCacheBuckets;}
+
+
+static resolution *cachedResolution(char *hostname) {
+  /* Expired entries met along the way are dropped. */
+
+  resolution **link = &resolvers.cache[hostnameHash(hostname)];
+  resolution *entry;
+  long long  now = monotonicMilliseconds();
+
+
+  while ((entry = *link) != NULL) {
+    if (entry->expiry <= now) {
+      *link = entry->next;
+      free(entry->hostname);
+      free(entry);
+      resolvers.numberOfResolutions--;}
+    else if (strcmp(entry->hostname, hostname) == 0)
+      return entry;
+    else link = &entry->next;}
+
+  return NULL;}
+
+
+static void cacheResolution(
+			    char *hostname,
+			    int	 found,
+			    char *addressBytes) {
+  int	     lifetime = found ? resolvers.lifetime : resolvers.failureLifetime;
+  int	     bucket;
+  resolution *entry;
+
+
+  if (lifetime <= 0) return;
+
+  if ((entry = cachedResolution(hostname)) == NULL) {
+    if (resolvers.numberOfResolutions >= ResolutionCacheCapacity) return;
+    if ((entry = (resolution *) calloc(1, sizeof(resolution))) == NULL) return;
+    if ((entry->hostname = strdup(hostname)) == NULL) {
+      free(entry);
+      return;}
+
+    bucket = hostnameHash(hostname);
+    entry->next = resolvers.cache[bucket];
+    resolvers.cache[bucket] = entry;
+    resolvers.numberOfResolutions++;}
+
+  entry->found = found;
+  if (found) memcpy(entry->addressBytes, addressBytes, 4);
+  entry->expiry = monotonicMilliseconds() + lifetime;}
+
+
+static void flushResolutionCache(void) {
+  resolution *entry;
+  int	     bucket;
+
+
+  for (bucket = 0; bucket < ResolutionCacheBuckets; bucket++)
+    while ((entry = resolvers.cache[bucket]) != NULL) {
+      resolvers.cache[bucket] = entry->next;
+      free(entry->hostname);
+      free(entry);}
+
+  resolvers.numberOfResolutions = 0;}
+
+
+static void freeResolver(resolver *resolverPointer) {
+  free(resolverPointer->hostname);
+  free((void *) resolverPointer);}
+
+
+static int queueResolver(resolver *resolverPointer) {
+  int	   newCapacity, index;
+  resolver **grown;
+
+
+  if (resolvers.numberOfRequests == resolvers.requestCapacity) {
+    newCapacity = (resolvers.requestCapacity == 0) ? 16 : resolvers.requestCapacity * 2;
+    grown = (resolver **) malloc(newCapacity * sizeof(resolver *));
+    if (grown == NULL) return FALSE;
+    for (index = 0; index < resolvers.numberOfRequests; index++)
+      grown[index] =
+	resolvers.requests[(resolvers.firstRequest + index) % resolvers.requestCapacity];
+    free(resolvers.requests);
+    resolvers.requests = grown;
+    resolvers.requestCapacity = newCapacity;
+    resolvers.firstRequest = 0;}
+
+  resolvers.requests[(resolvers.firstRequest + resolvers.numberOfRequests++)
+		     % resolvers.requestCapacity] = resolverPointer;
+  pthread_cond_signal(&resolvers.requestsPending);
+  return TRUE;}
+#endif
+
+
 /*
  * thread functions
  */
 
-/* Resolve network addresses. */
+#ifdef UNIXISH
+/* Resolve network addresses, for any resolver. */
 void resolve(void *parameter) {
-  struct hostent *host;
-  resolver       *resolverPointer = (resolver *) parameter;
-  int            result;
- 
+  resolver *resolverPointer;
+  char	   *hostname,
+           addressBytes[4];
+  int	   found;
+
+
   for(;;) {
-    waitForThreadSignal(&resolverPointer->sync);
-    if (resolverPointer->state == flowClosed) break;
-    host = gethostbyname(resolverPointer->hostname);
-    result = lastError();
+    pthread_mutex_lock(&resolvers.mutex);
+    while (resolvers.running && (resolvers.numberOfRequests == 0))
+      pthread_cond_wait(&resolvers.requestsPending, &resolvers.mutex);
+    if (!resolvers.running) {
+      pthread_mutex_unlock(&resolvers.mutex);
+      break;}
 
-    if (host == 0) {
-      if (result == NO_RECOVERY) break;
-      else {goto signal;}}
+    resolverPointer = resolvers.requests[resolvers.firstRequest];
+    resolvers.firstRequest = (resolvers.firstRequest + 1) % resolvers.requestCapacity;
+    resolvers.numberOfRequests--;
 
-    if (result != HOST_NOT_FOUND) {
-      resolverPointer->result = convertedInteger(host->h_addr_list[0] != 0);
-      memcpy(
-	     resolverPointer->addressBytes,
-	     host->h_addr_list[0],
-	     4);}
+    /* closeResolver() leaves busy resolvers for us to free. */
+    if (resolverPointer->state == flowClosed) {
+      freeResolver(resolverPointer);
+      pthread_mutex_unlock(&resolvers.mutex);
+      continue;}
 
-  signal:
-    synchronizedSignalSemaphoreWithIndex(resolverPointer->sync.semaphore);}}
+    /* The latest hostname may have been answered from the cache since. */
+    if (resolverPointer->answered) {
+      resolverPointer->busy = FALSE;
+      pthread_mutex_unlock(&resolvers.mutex);
+      continue;}
+
+    hostname = strdup(resolverPointer->hostname);
+    pthread_mutex_unlock(&resolvers.mutex);
+
+    found = (hostname != NULL) && lookUpHost(hostname, addressBytes);
+
+    pthread_mutex_lock(&resolvers.mutex);
+    if (hostname != NULL) cacheResolution(hostname, found, addressBytes);
+    if (resolverPointer->state == flowClosed)
+      freeResolver(resolverPointer);
+    else if ((hostname != NULL) && (strcmp(hostname, resolverPointer->hostname) != 0)) {
+      /*
+       * The image asked for another hostname meanwhile. Unless that
+       * was answered from the cache, resolve it in turn; this answer
+       * is for a name nobody wants any more.
+       */
+      if (resolverPointer->answered) resolverPointer->busy = FALSE;
+      else if (!queueResolver(resolverPointer)) {
+	resolverPointer->busy = FALSE;
+	finishResolution(resolverPointer, FALSE, addressBytes);}}
+    else {
+      resolverPointer->busy = FALSE;
+      finishResolution(resolverPointer, found, addressBytes);}
+    pthread_mutex_unlock(&resolvers.mutex);
+
+    free(hostname);}}
+
+
+int startResolverPool(void) {
+  int index;
+
+
+  if (resolvers.running) return TRUE;
+
+  resolvers.running = TRUE;
+  resolvers.numberOfWorkers = 0;
+  for (index = 0; index < ResolverPoolSize; index++) {
+    if (!startThread(
+		     &resolvers.workers[index],
+		     resolve,
+		     NULL))
+      break;
+    resolvers.numberOfWorkers++;}
+
+  if (resolvers.numberOfWorkers == 0) {
+    resolvers.running = FALSE;
+    return FALSE;}
+
+  return TRUE;}
+
+
+void stopResolverPool(void) {
+  int index;
+
+
+  if (!resolvers.running) return;
+
+  pthread_mutex_lock(&resolvers.mutex);
+  resolvers.running = FALSE;
+  pthread_cond_broadcast(&resolvers.requestsPending);
+  pthread_mutex_unlock(&resolvers.mutex);
+
+  for (index = 0; index < resolvers.numberOfWorkers; index++)
+    pthread_join(resolvers.workers[index].thread, NULL);
+  resolvers.numberOfWorkers = 0;
+  flushResolutionCache();}
+#else
+/* There is no shared pool on this platform; resolve inline. */
+
+int startResolverPool(void) {
+  return TRUE;}
+
+
+void stopResolverPool(void) {}
+#endif
+
+
+static int spinUntilReady(
+			  thread	 *thread,
+			  int		 socket,
+			  int		 forWriting,
+			  struct timeval *delayPointer) {
+  /*
+   * In low-latency mode, poll the socket without blocking until it
+   * is ready or the thread's spin budget is spent. Answer TRUE if it
+   * became ready. Otherwise, take the time spent out of the delay
+   * for the blocking select() which follows.
+   */
+
+  struct timeval none;
+  fd_set	 descriptors;
+  long long	 started, remaining, spent = 0;
+  int		 result;
+
+
+  if (thread->spinBudget <= 0) return FALSE;
+
+  started = monotonicMicroseconds();
+  do {
+    FD_ZERO(&descriptors);
+    FD_SET(
+	   socket,
+	   &descriptors);
+    none.tv_sec = 0;
+    none.tv_usec = 0;
+    result = select(
+		    socket + 1,
+		    forWriting ? 0 : &descriptors,
+		    forWriting ? &descriptors : 0,
+		    0,
+		    &none);
+    /* Let the blocking select() report errors. */
+    if (result != 0) break;
+    spent = monotonicMicroseconds() - started;}
+  while (spent < thread->spinBudget);
+
+  if (result > 0) {
+    thread->spinsSatisfied++;
+    return TRUE;}
+
+  thread->spinsExhausted++;
+  if (delayPointer != NULL) {
+    remaining = ((long long) delayPointer->tv_sec * 1000000) + delayPointer->tv_usec - spent;
+    if (remaining < 0) remaining = 0;
+    delayPointer->tv_sec = remaining / 1000000;
+    delayPointer->tv_usec = remaining % 1000000;}
+
+  return FALSE;}
 
 
 /* Connect or accept to open a connection, then handle read requests. */
@@ -96,7 +497,7 @@ void waitForConnectionsAndReceivedData(void *parameter) {
                  exceptionFileDescriptors;
 
   for(;;) {
-    waitForThreadSignal(&socketPointer->resource.reading.sync);
+    waitForThreadRequest(&socketPointer->resource.reading);
 
     if (socketPointer->resource.reading.timeout == -1)
       delayPointer = NULL;
@@ -116,7 +517,12 @@ void waitForConnectionsAndReceivedData(void *parameter) {
       goto signal;}
 
 
-    if (operation == flowRead || operation == flowAccept) {
+    if ((operation == flowRead) && (socketPointer->resource.receiveQueue != NULL))
+      /* Receive into the queue until there's enough to deliver. */
+      result = fillReceiveQueue(
+				&socketPointer->resource,
+				socketPointer->resource.reading.timeout);
+    else if (operation == flowRead || operation == flowAccept) {
       FD_ZERO(&readingFileDescriptors);
       FD_SET(
 	     socket,
@@ -126,12 +532,19 @@ void waitForConnectionsAndReceivedData(void *parameter) {
        * Perform a blocking select(), so that this thread waits
        * for at least one byte of received data before continuing.
        */
-      selectResult = select(
-			    socket + 1,
-			    &readingFileDescriptors,
-			    0,
-			    0,
-			    delayPointer);
+      if (spinUntilReady(
+			 &socketPointer->resource.reading,
+			 socket,
+			 FALSE,
+			 delayPointer))
+	selectResult = 1;
+      else
+	selectResult = select(
+			      socket + 1,
+			      &readingFileDescriptors,
+			      0,
+			      0,
+			      delayPointer);
 
       switch(selectResult) {
         case 0:
@@ -197,7 +610,7 @@ void waitForConnectionsAndReceivedData(void *parameter) {
     socketPointer->resource.reading.result = convertedInteger(result);
     if (socketPointer->resource.reading.result == timeout)
       result = result;
-    synchronizedSignalSemaphoreWithIndex(socketPointer->resource.reading.sync.semaphore);}}
+    signalThreadOperation(&socketPointer->resource.reading);}}
 
 
 /* Handle writing requests. */
@@ -213,7 +626,25 @@ void waitForSendBufferSpace(void *parameter) {
   flowSocket	 *socketPointer = (flowSocket *) parameter;
 
   for(;;) {
-    waitForThreadSignal(&socketPointer->resource.writing.sync);
+    waitForThreadRequest(&socketPointer->resource.writing);
+
+    if (socketPointer->resource.sendQueue != NULL) {
+      /*
+       * The VM waits for the queue to drain to its low watermark.
+       * Either way, keep draining it until the next request.
+       */
+      if (socketPointer->resource.writing.operation == flowWrite) {
+	result = drainSendQueue(
+				&socketPointer->resource,
+				((sendQueue *) socketPointer->resource.sendQueue)->lowWatermark,
+				socketPointer->resource.writing.timeout);
+	socketPointer->resource.writing.result = convertedInteger(result);
+	signalThreadOperation(&socketPointer->resource.writing);}
+      drainSendQueue(
+		     &socketPointer->resource,
+		     -1,
+		     -1);
+      continue;}
 
     if (socketPointer->resource.writing.timeout == -1) delayPointer = NULL;
     else {
@@ -244,12 +675,19 @@ void waitForSendBufferSpace(void *parameter) {
       result = error;
       goto signal;}
 
-    selectResult = select(
-			  socket + 1,
-			  0,
-			  &writingFileDescriptors,
-			  &errorFileDescriptors,
-			  delayPointer);
+    if (spinUntilReady(
+		       &socketPointer->resource.writing,
+		       socket,
+		       TRUE,
+		       delayPointer))
+      selectResult = 1;
+    else
+      selectResult = select(
+			    socket + 1,
+			    0,
+			    &writingFileDescriptors,
+			    &errorFileDescriptors,
+			    delayPointer);
 
     switch(selectResult) {
       case 0:
@@ -269,7 +707,208 @@ void waitForSendBufferSpace(void *parameter) {
       break;}
 
     socketPointer->resource.writing.result = convertedInteger(result);
-    synchronizedSignalSemaphoreWithIndex(socketPointer->resource.writing.sync.semaphore);}}
+    signalThreadOperation(&socketPointer->resource.writing);}}
+
+
+#ifdef UNIXISH
+static int readVector(
+		      int	   regions,
+		      struct iovec *vector) {
+  /*
+   * Fill the vector from an Array of ByteArray, start index and
+   * length triples, checking that each region lies within its
+   * ByteArray. Answer the number of regions, or -1 if the Array
+   * isn't suitable.
+   */
+
+  int bytes, start, length, index, count;
+
+
+  if (!(vm->fetchClassOf(regions) == (vm->classArray()))) return -1;
+  count = vm->slotSizeOf(regions) / 3;
+  if ((count == 0)
+      || (count > MaximumVectorLength)
+      || ((count * 3) != vm->slotSizeOf(regions)))
+    return -1;
+
+  for (index = 0; index < count; index++) {
+    bytes = vm->fetchPointerofObject(index * 3, regions);
+    start = vm->fetchIntegerofObject((index * 3) + 1, regions);
+    length = vm->fetchIntegerofObject((index * 3) + 2, regions);
+    if (vm->failed()
+	|| !(vm->isWordsOrBytes(bytes))
+	|| (start < 1)
+	|| (length < 0)
+	|| ((start - 1 + length) > vm->byteSizeOf(bytes)))
+      return -1;
+
+    vector[index].iov_base = (void *) (bytes + BaseHeaderSize + start - 1);
+    vector[index].iov_len = length;}
+
+  return count;}
+#endif
+
+
+static void writeAddressBytes(
+			      struct sockaddr_in *address,
+			      char		 *target) {
+  /* Write the address as the image has it: four address bytes, then the port. */
+
+  unsigned short port = ntohs(address->sin_port);
+
+
+  memcpy(
+	 target,
+	 &address->sin_addr.s_addr,
+	 4);
+  memcpy(
+	 target + 4,
+	 &port,
+	 2);}
+
+
+static void readAddressBytes(
+			     char		*source,
+			     struct sockaddr_in *address) {
+  unsigned short port;
+
+
+  memset(address, 0, sizeof(*address));
+  address->sin_family = AF_INET;
+  memcpy(
+	 &address->sin_addr.s_addr,
+	 source,
+	 4);
+  memcpy(
+	 &port,
+	 source + 4,
+	 2);
+  address->sin_port = htons(port);}
+
+
+static int watchTCPSocket(flowSocket *socketPointer) {
+  /*
+   * Arrange for the readiness of a newly opened TCP socket to be
+   * noticed, according to the current readiness model. Answer
+   * FALSE if that couldn't be done.
+   */
+
+  netResource *resource = &socketPointer->resource;
+
+
+  resource->model = readinessModel;
+  switch (readinessModel) {
+    case reactorModel:
+      return registerWithReactor(resource);
+    case completionRingModel:
+      return attachToCompletionRing(resource);
+    case pooledWorkersModel:
+      /* Workers are borrowed for each wait; there's nothing to start. */
+      return TRUE;
+    default:
+      return startScribingThreads(
+				  resource,
+				  waitForSendBufferSpace,
+				  waitForConnectionsAndReceivedData,
+				  (void *) socketPointer);}}
+
+
+static int bindAndListen(
+			 flowSocket *socketPointer,
+			 int	    port,
+			 int	    queueSize) {
+  struct sockaddr_in address;
+
+
+  address.sin_addr.s_addr = htonl(INADDR_ANY);
+  address.sin_port = ntohs((unsigned short) port);
+  address.sin_family = AF_INET;
+
+  if ((bind(
+	    socketPointer->resource.handle,
+	    (struct sockaddr *) &address,
+	    sizeof address)
+       < 0)
+      || (listen(socketPointer->resource.handle, queueSize) < 0))
+    return FALSE;
+
+  socketPointer->state = flowListening;
+  return TRUE;}
+
+
+static int levelAndNameOfOption(
+				int option,
+				int *level,
+				int *name) {
+  /*
+   * Answer the setsockopt() level and name of a TCP option, or FALSE
+   * if the option is unknown or this platform hasn't got it.
+   */
+
+  *level = IPPROTO_TCP;
+  switch (option) {
+    case noDelayOption:
+      *name = TCP_NODELAY;
+      return TRUE;
+#ifdef TCP_CORK
+    case corkOption:
+    case autoCorkOption:
+      *name = TCP_CORK;
+      return TRUE;
+#endif
+#ifdef TCP_QUICKACK
+    case quickAckOption:
+      *name = TCP_QUICKACK;
+      return TRUE;
+#endif
+    case sendBufferSizeOption:
+      *level = SOL_SOCKET;
+      *name = SO_SNDBUF;
+      return TRUE;
+    case receiveBufferSizeOption:
+      *level = SOL_SOCKET;
+      *name = SO_RCVBUF;
+      return TRUE;
+#ifdef TCP_FASTOPEN
+    case fastOpenOption:
+      *name = TCP_FASTOPEN;
+      return TRUE;
+#endif
+#ifdef TCP_FASTOPEN_CONNECT
+    case fastOpenConnectOption:
+      *name = TCP_FASTOPEN_CONNECT;
+      return TRUE;
+#endif
+    default:
+      return FALSE;}}
+
+
+void countTransfer(
+		   flowSocket *socketPointer,
+		   thread     *operation,
+		   int	      moved,
+		   int	      wouldBlock) {
+  /*
+   * Tally a call of a reading or writing primitive, which moved the
+   * given number of bytes (-1 if it failed), whether it found nothing
+   * to do, and how long it came after the readiness signal which
+   * (presumably) prompted it. Only the VM's thread calls this.
+   */
+
+  long long signalledAt = __atomic_exchange_n(&operation->signalledAt, 0, __ATOMIC_RELAXED);
+
+
+  socketPointer->calls++;
+  if (moved > 0) {
+    if (operation == &socketPointer->resource.reading)
+      socketPointer->bytesIn += moved;
+    else
+      socketPointer->bytesOut += moved;}
+  if (wouldBlock) socketPointer->wouldBlocks++;
+
+  if (signalledAt != 0) {
+    socketPointer->signalDelay += monotonicMicroseconds() - signalledAt;
+    socketPointer->signalsTaken++;}}
 
 
 /*
@@ -294,11 +933,10 @@ void enableResolver(void) {
     resolverPointer->hostname[0] = '\0';
     resolverPointer->address.s_addr = 0;
     resolverPointer->state = flowOpen;
+    resolverPointer->busy = FALSE;
 
-    if (!startThread(
-		     &resolverPointer->sync,
-		     resolve,
-		     (void *) resolverAddress))
+    /* Resolvers share a pool of threads, rather than having one each. */
+    if (!startResolverPool())
       vm->primitiveFail();
     else
       vm->pop(1);}}
@@ -325,7 +963,13 @@ void notifyAfterResolvingHostNamed(void) {
    * afterResolvingHostNamed: hostname
    */
 
-  resolver *resolverPointer = (resolver *)(addressForStackValue(1));
+  resolver   *resolverPointer = (resolver *)(addressForStackValue(1));
+  char	     *hostname;
+#ifdef UNIXISH
+  resolution *cached;
+#else
+  char	     addressBytes[4];
+#endif
 
 
   if (!(vm->failed())) {
@@ -333,10 +977,41 @@ void notifyAfterResolvingHostNamed(void) {
       vm->primitiveFail();
       return;}
 
-    resolverPointer->hostname = copyStringAt(0);
-    if (resolverPointer->hostname == NULL) return;
+    hostname = copyStringAt(0);
+    if (hostname == NULL) return;
+
+#ifdef UNIXISH
+    pthread_mutex_lock(&resolvers.mutex);
+    free(resolverPointer->hostname);
+    resolverPointer->hostname = hostname;
+
+    resolverPointer->answered = ((cached = cachedResolution(hostname)) != NULL);
+    if (resolverPointer->answered)
+      /*
+       * Answer right away, without involving the pool. A lookup
+       * still in flight for an earlier hostname won't answer again.
+       */
+      finishResolution(resolverPointer, cached->found, cached->addressBytes);
+    else if (!resolverPointer->busy) {
+      /*
+       * A resolver already queued just resolves the newest
+       * hostname, as a dedicated thread would have.
+       */
+      if (!queueResolver(resolverPointer)) {
+	pthread_mutex_unlock(&resolvers.mutex);
+	vm->primitiveFail();
+	return;}
+      resolverPointer->busy = TRUE;}
+    pthread_mutex_unlock(&resolvers.mutex);
+#else
+    free(resolverPointer->hostname);
+    resolverPointer->hostname = hostname;
+    finishResolution(
+		     resolverPointer,
+		     lookUpHost(hostname, addressBytes),
+		     addressBytes);
+#endif
 
-    signalThread(&resolverPointer->sync);
     vm->pop(2);}}
 
 
@@ -395,12 +1070,45 @@ void closeResolver(void) {
 
 
   if (!(vm->failed())) {
+#ifdef UNIXISH
+    pthread_mutex_lock(&resolvers.mutex);
     resolverPointer->state = flowClosed;
-    stopThread(&resolverPointer->sync);
+    /* A pool thread frees a busy resolver when it's done with it. */
+    if (!resolverPointer->busy) freeResolver(resolverPointer);
+    pthread_mutex_unlock(&resolvers.mutex);
+#else
+    free(resolverPointer->hostname);
     free((void *) resolverPointer);
+#endif
     vm->pop(1);}}
 
 
+void cacheResolutionsForAndFailuresFor(void) {
+  /*
+   * cacheResolutionsFor: resolutionMilliseconds
+   * andFailuresFor: failureMilliseconds
+   */
+
+  /*
+   * Set how long resolutions and failed resolutions are remembered,
+   * for lookups from now on. Zero turns either kind of caching off.
+   */
+
+  int lifetime = vm->stackIntegerValue(1);
+  int failureLifetime = vm->stackIntegerValue(0);
+
+
+  if (!(vm->failed())) {
+#ifdef UNIXISH
+    pthread_mutex_lock(&resolvers.mutex);
+    resolvers.lifetime = lifetime;
+    resolvers.failureLifetime = failureLifetime;
+    if ((lifetime <= 0) && (failureLifetime <= 0)) flushResolutionCache();
+    pthread_mutex_unlock(&resolvers.mutex);
+#endif
+    vm->pop(2);}}
+
+
 void newSocketHandleInto(void) {
   /* newResourceHandleInto: theHandle */
 
@@ -454,14 +1162,10 @@ void enableSocketUsingTCP(void) {
     socketPointer->transport = transport;
     socketPointer->resource.handle = aSocket;
 
-    if (transport == TCP) {
-      if (!startScribingThreads(
-				&socketPointer->resource,
-				waitForSendBufferSpace,
-				waitForConnectionsAndReceivedData,
-				(void *) socketAddress)) {
-	vm->primitiveFail();
-	return;}}
+    if ((transport == TCP) && !watchTCPSocket(socketPointer)) {
+      close(aSocket);
+      vm->primitiveFail();
+      return;}
     vm->pop(2);}}
 
 
@@ -530,28 +1234,43 @@ void notifySocketWhenItMayPerformTimeoutAfter(void) {
    * notify: socketHandle
    * whenItMayPerform: operation
    * timeoutAfter: timeoutInMilliseconds
+   *
+   * With scribing threads, each direction queues up to
+   * ThreadRequestRingSize distinct requests; a request identical to
+   * one still pending is coalesced with it. The primitive fails if
+   * the queue is full, and the caller should wait on the semaphore
+   * before asking again.
    */
 
   flowSocket *socketPointer = (flowSocket *) (addressForStackValue(2));
 
   if (!(vm->failed())) {
+    socketPointer->waits++;
+    /* The process is about to wait, so its burst of writes is over. */
+    uncorkSockets();
     switch(vm->stackIntegerValue(1)) {
       case flowConnect:
       case flowAccept:
       case flowRead:
 	/*
-	 * signalSynchronizedResourceThread() pops the parameters from
+	 * notifySynchronizedResource() pops the parameters from
 	 * the object stack
 	 */
-	signalSynchronizedResourceThread(&socketPointer->resource.reading);
+	if (!notifySynchronizedResource(
+					&socketPointer->resource,
+					&socketPointer->resource.reading))
+	  vm->primitiveFail();
 	break;
 
       case flowWrite:
 	/*
-	 * signalSynchronizedResourceThread() pops the parameters from
+	 * notifySynchronizedResource() pops the parameters from
 	 * the object stack
 	 */
-	signalSynchronizedResourceThread(&socketPointer->resource.writing);
+	if (!notifySynchronizedResource(
+					&socketPointer->resource,
+					&socketPointer->resource.writing))
+	  vm->primitiveFail();
 	break;
 
       default:
@@ -609,12 +1328,115 @@ void acceptFrom(void) {
       vm->primitiveFail();
       return;}
 
-    close(clientsocketPointer->resource.handle);
-    clientsocketPointer->resource.handle = result;
+    if (!replaceResourceHandle(&clientsocketPointer->resource, result)) {
+      vm->primitiveFail();
+      return;}
 
     vm->pop(2);}}
 
 
+void acceptUpToFromInto(void) {
+  /*
+   * acceptUpTo: maximumConnections
+   * from: serverHandle
+   * into: handlesByteArray
+   */
+
+  /*
+   * Accept as many pending connections as are waiting, up to the
+   * given maximum, without blocking. Each gets a fresh socket
+   * handle, already enabled for TCP, and the handles are written
+   * into the ByteArray, four bytes each. Answer how many there
+   * were (possibly none).
+   */
+
+  int	     maximum = vm->stackIntegerValue(2);
+  flowSocket *serverSocketPointer = (flowSocket *) (addressForStackValue(1));
+  int	     handles = vm->stackObjectValue(0);
+  flowSocket *clientSocketPointer;
+  int	     nonblocking = TRUE, wasNonblocking = FALSE;
+  int	     count = 0, failed = FALSE;
+  int	     result, clientAddress;
+
+
+  if (!(vm->failed())) {
+    if ((serverSocketPointer->state != flowListening)
+	|| !(vm->fetchClassOf(handles) == (vm->classByteArray()))) {
+      vm->primitiveFail();
+      return;}
+    if (maximum > (vm->byteSizeOf(handles) / 4))
+      maximum = vm->byteSizeOf(handles) / 4;
+
+    /*
+     * Make the server nonblocking while draining it, and put it back
+     * afterwards, so that a later accept:from: still blocks.
+     */
+#ifdef UNIXISH
+    wasNonblocking = (fcntl(
+			    serverSocketPointer->resource.handle,
+			    F_GETFL)
+		      & O_NONBLOCK) != 0;
+#endif
+    if (!wasNonblocking)
+      ioctl(
+	    serverSocketPointer->resource.handle,
+	    FIONBIO,
+	    &nonblocking);
+
+    while (count < maximum) {
+#ifdef LINUXISH
+      result = accept4(
+		       serverSocketPointer->resource.handle,
+		       0,
+		       0,
+		       SOCK_NONBLOCK | SOCK_CLOEXEC);
+#else
+      result = accept(
+		      serverSocketPointer->resource.handle,
+		      0,
+		      0);
+#endif
+      if (result < 0) {
+	if (lastError() == EINTR) continue;
+	/* Answer those accepted so far, or fail if a real error came first. */
+	if ((count == 0) && (lastError() != EAGAIN) && (lastError() != EWOULDBLOCK))
+	  failed = TRUE;
+	break;}
+
+      clientAddress = (int) calloc(1, sizeof(flowSocket));
+      clientSocketPointer = (flowSocket *) clientAddress;
+      if (clientSocketPointer == NULL) {
+	close(result);
+	break;}
+      clientSocketPointer->state = flowOpen;
+      clientSocketPointer->transport = TCP;
+      clientSocketPointer->resource.handle = result;
+      if (!watchTCPSocket(clientSocketPointer)) {
+	close(result);
+	free((void *) clientSocketPointer);
+	break;}
+
+      memcpy(
+	     (void *) (handles + BaseHeaderSize + (count * 4)),
+	     (const void *) &clientAddress,
+	     4);
+      count++;}
+
+    if (!wasNonblocking) {
+      nonblocking = FALSE;
+      ioctl(
+	    serverSocketPointer->resource.handle,
+	    FIONBIO,
+	    &nonblocking);}
+
+    if (failed) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(4);
+    vm->pushInteger(count);}}
+
+
 void socketTimedOut(void) {
   /* timedOut: socketHandle */
 
@@ -655,38 +1477,279 @@ void listenAtPortQueueSizeTCPSocket(void) {
    * socket: socketHandle
    */
 
-  flowSocket	     *socketPointer = (flowSocket *) (addressForStackValue(0));
-  int		     queueSize = vm->stackIntegerValue(1);
-  int		     port = vm->stackIntegerValue(2);
-  int		     result;
-  struct sockaddr_in address;
+  flowSocket *socketPointer = (flowSocket *) (addressForStackValue(0));
+  int	     queueSize = vm->stackIntegerValue(1);
+  int	     port = vm->stackIntegerValue(2);
 
 
   if (!(vm->failed())) {
-    address.sin_addr.s_addr = htonl(INADDR_ANY);
-    address.sin_port = ntohs((unsigned short) port);
-    address.sin_family = AF_INET;
-
-    result = bind(
-		  socketPointer->resource.handle,
-		  (struct sockaddr *) &address,
-		  sizeof address);
-    if (result < 0) {
-      vm->primitiveFail();
-      return;}
-    if (listen(socketPointer->resource.handle,queueSize) < 0) {
+    if (!bindAndListen(socketPointer, port, queueSize)) {
       vm->primitiveFail();
       return;}
 
-    socketPointer->state = flowListening;
-
     vm->pop(3);}}
 
 
-void peerAddressIntoNameIntoTCPSocket(void) {
+void listenAtPortQueueSizeSharedTCPSocket(void) {
   /*
-   * peerAddressInto: aByteArray
-   * nameInto: aString
+   * listenAtPort: thePort
+   * queueSize: theQueueSize
+   * sharedTCPSocket: socketHandle
+   */
+
+  /*
+   * Listen as listenAtPort:queueSize:socket: does, but with
+   * SO_REUSEPORT, so that other sockets (in this VM or others run by
+   * the same user) may listen at the same port too. The kernel then
+   * spreads incoming connections among them, by a hash of each
+   * connection's addresses unless a steering program says otherwise.
+   */
+
+#ifdef SO_REUSEPORT
+  flowSocket *socketPointer = (flowSocket *) (addressForStackValue(0));
+  int	     queueSize = vm->stackIntegerValue(1);
+  int	     port = vm->stackIntegerValue(2);
+  int	     on = 1;
+
+
+  if (!(vm->failed())) {
+    if ((setsockopt(
+		    socketPointer->resource.handle,
+		    SOL_SOCKET,
+		    SO_REUSEPORT,
+		    &on,
+		    sizeof(on))
+	 < 0)
+	|| !bindAndListen(socketPointer, port, queueSize)) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(3);}
+#else
+  vm->primitiveFail();
+#endif
+}
+
+
+#if ((defined LINUXISH) && (defined SO_ATTACH_REUSEPORT_CBPF))
+static int attachSteeringProgram(
+				 int		   socket,
+				 struct sock_filter *instructions,
+				 int		   count) {
+  struct sock_fprog program;
+
+
+  program.len = count;
+  program.filter = instructions;
+  return setsockopt(
+		    socket,
+		    SOL_SOCKET,
+		    SO_ATTACH_REUSEPORT_CBPF,
+		    &program,
+		    sizeof(program))
+    == 0;}
+#endif
+
+
+void steerConnectionsForTCPSocketByAmong(void) {
+  /*
+   * steerConnectionsFor: socketHandle
+   * by: steering
+   * among: numberOfListeners
+   */
+
+  /*
+   * Attach a steering program to the group of listeners sharing the
+   * socket's port (the socket must be one of them). With cpuSteering,
+   * each connection goes to the listener numbered by the CPU which
+   * received it, modulo the number of listeners, so that a VM pinned
+   * to a CPU serves that CPU's connections. With hashSteering, the
+   * received packet's hash chooses. Listeners are numbered from zero,
+   * in the order they began listening; when one closes, the last
+   * takes its number. Connections whose number has no listener are
+   * spread by the kernel as usual.
+   */
+
+#if ((defined LINUXISH) && (defined SO_ATTACH_REUSEPORT_CBPF))
+  flowSocket	     *socketPointer = (flowSocket *) (addressForStackValue(2));
+  int		     steering = vm->stackIntegerValue(1);
+  int		     among = vm->stackIntegerValue(0);
+  struct sock_filter program[3] = {
+    BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF),
+    BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, 0),
+    BPF_STMT(BPF_RET | BPF_A, 0)};
+
+
+  if (!(vm->failed())) {
+    if (((steering != cpuSteering) && (steering != hashSteering))
+	|| (among < 1)) {
+      vm->primitiveFail();
+      return;}
+
+    program[0].k += (steering == cpuSteering) ? SKF_AD_CPU : SKF_AD_RXHASH;
+    program[1].k = among;
+    if (!attachSteeringProgram(socketPointer->resource.handle, program, 3)) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(3);}
+#else
+  vm->primitiveFail();
+#endif
+}
+
+
+void attachSteeringProgramToTCPSocket(void) {
+  /*
+   * attachSteeringProgram: instructions
+   * toTCPSocket: socketHandle
+   */
+
+  /*
+   * Attach a classic BPF program of the image's own to the group of
+   * listeners sharing the socket's port. The instructions are a
+   * ByteArray of eight-byte struct sock_filter entries, in the
+   * platform's byte order. The program runs on each connection's
+   * first packet, and answers the number of the listener to take it.
+   */
+
+#if ((defined LINUXISH) && (defined SO_ATTACH_REUSEPORT_CBPF))
+  int	     instructions = vm->stackObjectValue(1);
+  flowSocket *socketPointer = (flowSocket *) (addressForStackValue(0));
+  int	     count;
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(instructions) == (vm->classByteArray()))) {
+      vm->primitiveFail();
+      return;}
+
+    count = vm->byteSizeOf(instructions) / sizeof(struct sock_filter);
+    if ((count == 0)
+	|| (count > BPF_MAXINSNS)
+	|| ((count * sizeof(struct sock_filter)) != vm->byteSizeOf(instructions))
+	|| !attachSteeringProgram(
+				  socketPointer->resource.handle,
+				  (struct sock_filter *) (instructions + BaseHeaderSize),
+				  count)) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(2);}
+#else
+  vm->primitiveFail();
+#endif
+}
+
+
+void setOptionForTCPSocketTo(void) {
+  /*
+   * setOption: option
+   * forTCPSocket: socketHandle
+   * to: value
+   */
+
+  /*
+   * Set one of the socket's TCP options (see flow.h); booleans are
+   * zero or one, and sizes are in bytes.
+   *
+   * - noDelayOption sends small writes at once, rather than
+   *   coalescing them while earlier bytes are unacknowledged.
+   * - corkOption holds back partial segments until it's cleared.
+   * - autoCorkOption corks the socket at each write, until the
+   *   writing process waits for a socket, the VM is given signals,
+   *   or the VM relinquishes the processor, so that the writes the
+   *   image makes in one burst go out in as few segments as
+   *   possible. A process which writes and then computes for long
+   *   without any of those happening may see the kernel's 200 ms
+   *   cork limit instead.
+   * - quickAckOption acknowledges received data at once; the kernel
+   *   may clear it again later.
+   * - sendBufferSizeOption and receiveBufferSizeOption size the
+   *   kernel's buffers, before connecting or listening for the
+   *   receive buffer to affect the window.
+   * - fastOpenOption, before listening, is how many Fast Open
+   *   connections may await acceptance.
+   * - fastOpenConnectOption, before connecting, lets the connection
+   *   finish at once, sending the first bytes written in the SYN.
+   */
+
+  int	     option = vm->stackIntegerValue(2);
+  flowSocket *socketPointer = (flowSocket *) (addressForStackValue(1));
+  int	     value = vm->stackIntegerValue(0);
+  int	     level, name;
+
+
+  if (!(vm->failed())) {
+    if (!levelAndNameOfOption(option, &level, &name)) {
+      vm->primitiveFail();
+      return;}
+
+    if (option == autoCorkOption) {
+      socketPointer->autoCork = (value != 0);
+      if (!value) {
+	forgetCorkedSocket(socketPointer);
+	setCork(socketPointer, FALSE);}}
+    else {
+      if (setsockopt(
+		     socketPointer->resource.handle,
+		     level,
+		     name,
+		     &value,
+		     sizeof(value))
+	  < 0) {
+	vm->primitiveFail();
+	return;}
+      /* A socket uncorked by hand needn't be uncorked again. */
+      if ((option == corkOption) && !value) forgetCorkedSocket(socketPointer);}
+
+    vm->pop(3);}}
+
+
+void optionForTCPSocket(void) {
+  /*
+   * option: option
+   * forTCPSocket: socketHandle
+   */
+
+  /*
+   * Answer the current value of one of the socket's TCP options, as
+   * the kernel has it. Buffer sizes include the kernel's bookkeeping
+   * overhead, so they're usually double what was set.
+   */
+
+  int	     option = vm->stackIntegerValue(1);
+  flowSocket *socketPointer = (flowSocket *) (addressForStackValue(0));
+  int	     level, name;
+  int	     value = 0;
+  socklen_t  size = sizeof(value);
+
+
+  if (!(vm->failed())) {
+    if (!levelAndNameOfOption(option, &level, &name)) {
+      vm->primitiveFail();
+      return;}
+
+    if (option == autoCorkOption)
+      value = socketPointer->autoCork;
+    else if (getsockopt(
+			socketPointer->resource.handle,
+			level,
+			name,
+			&value,
+			&size)
+	     < 0) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(3);
+    vm->pushInteger(value);}}
+
+
+void peerAddressIntoNameIntoTCPSocket(void) {
+  /*
+   * peerAddressInto: aByteArray
+   * nameInto: aString
    * socket: socketHandle
    */
 
@@ -749,6 +1812,11 @@ void dataAvailableForSocket(void) {
 		      2,
 		      vm->falseObject());
       return;}
+    else if (queuedByteCount(&socketPointer->resource) > 0) {
+      vm->popthenPush(
+		      2,
+		      vm->trueObject());
+      return;}
     else {
       /* Perform a blocking select() with a zero-duration timeoutInMilliseconds. */
       nonblocking = FALSE;
@@ -800,12 +1868,29 @@ void nextFromTCPSocketIntoStartingAt(void) {
       vm->primitiveFail();
       return;}
 
-    result = recv(
-		  socketPointer->resource.handle,
-		  (char *)(targetBytes + BaseHeaderSize + targetStartIndex - 1),
-		  bytesToRead,
-		  0);
+    if (socketPointer->resource.model == completionRingModel)
+      /* The ring has received already; just copy out. */
+      result = takeReceivedBytes(
+				 &socketPointer->resource,
+				 (char *)(targetBytes + BaseHeaderSize + targetStartIndex - 1),
+				 bytesToRead);
+    else if (socketPointer->resource.receiveQueue != NULL)
+      result = takeQueuedBytes(
+			       &socketPointer->resource,
+			       (char *)(targetBytes + BaseHeaderSize + targetStartIndex - 1),
+			       bytesToRead);
+    else
+      result = recv(
+		    socketPointer->resource.handle,
+		    (char *)(targetBytes + BaseHeaderSize + targetStartIndex - 1),
+		    bytesToRead,
+		    0);
 
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.reading,
+		  result,
+		  wouldHaveBlocked(result));
     if (result == -1) {
       vm->primitiveFail();
       return;}
@@ -814,6 +1899,76 @@ void nextFromTCPSocketIntoStartingAt(void) {
     vm->pushInteger(result);}}
 
 
+void nextVectorFromTCPSocketInto(void) {
+  /*
+   * nextVectorFrom: tcpSocketHandle
+   * into: regionsArray
+   */
+
+  /*
+   * Receive into several regions, each given in the Array as a
+   * ByteArray (or String), a start index and a length, with one
+   * system call; for example, a fixed-size header and then a body.
+   * The regions are filled in order. Answer the total number of
+   * bytes received.
+   */
+
+#ifdef UNIXISH
+  flowSocket   *socketPointer = (flowSocket *) (addressForStackValue(1));
+  int	       regions = vm->stackObjectValue(0);
+  struct iovec vector[MaximumVectorLength];
+  int	       count, index, taken;
+  ssize_t      result;
+
+
+  if (!(vm->failed())) {
+    if ((count = readVector(regions, vector)) < 0) {
+      vm->primitiveFail();
+      return;}
+
+    if ((socketPointer->resource.model == completionRingModel)
+	|| (socketPointer->resource.receiveQueue != NULL)) {
+      /* The ring or queue has received already; copy out until it runs dry. */
+      result = 0;
+      for (index = 0; index < count; index++) {
+	if (socketPointer->resource.model == completionRingModel)
+	  taken = takeReceivedBytes(
+				    &socketPointer->resource,
+				    (char *) vector[index].iov_base,
+				    vector[index].iov_len);
+	else
+	  taken = takeQueuedBytes(
+				  &socketPointer->resource,
+				  (char *) vector[index].iov_base,
+				  vector[index].iov_len);
+	if (taken == -1) {
+	  if (result == 0) result = -1;
+	  break;}
+	result += taken;
+	if (taken < vector[index].iov_len) break;}}
+    else
+      result = readv(
+		     socketPointer->resource.handle,
+		     vector,
+		     count);
+
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.reading,
+		  result,
+		  wouldHaveBlocked(result));
+    if (result == -1) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(3);
+    vm->pushInteger(result);}
+#else
+  vm->primitiveFail();
+#endif
+}
+
+
 /* Give something back to the universe... */
 void nextPutFromToTCPSocketStartingAt(void) {
   /*
@@ -839,6 +1994,55 @@ void nextPutFromToTCPSocketStartingAt(void) {
       vm->primitiveFail();
       return;}
 
+    corkUntilBoundary(socketPointer);
+    if (socketPointer->resource.model == completionRingModel) {
+      /*
+       * Copy the bytes out and queue them with the ring. This fails
+       * while a previous send is still in flight; the writability
+       * semaphore is signalled when it completes.
+       */
+      result = queueSend(
+			 &socketPointer->resource,
+			 (char *) (sourceBytes + BaseHeaderSize + vm->stackIntegerValue(0) - 1),
+			 vm->stackIntegerValue(3));
+      countTransfer(
+		    socketPointer,
+		    &socketPointer->resource.writing,
+		    result,
+		    wouldHaveBlocked(result));
+      if (result == -1) {
+	vm->primitiveFail();
+	return;}
+
+      socketPointer->resource.writing.result = convertedInteger(result);
+      vm->pop(5);
+      vm->pushInteger(result);
+      return;}
+
+    if (socketPointer->resource.sendQueue != NULL) {
+      /*
+       * Accept whatever fits below the high watermark. This answers
+       * zero, rather than failing, when the queue is full.
+       */
+      result = queueBytesToSend(
+				&socketPointer->resource,
+				(char *) (sourceBytes + BaseHeaderSize + vm->stackIntegerValue(0) - 1),
+				vm->stackIntegerValue(3));
+      /* A full queue takes nothing, rather than failing. */
+      countTransfer(
+		    socketPointer,
+		    &socketPointer->resource.writing,
+		    result,
+		    (result == 0) && (vm->stackIntegerValue(3) > 0));
+      if (result == -1) {
+	vm->primitiveFail();
+	return;}
+
+      socketPointer->resource.writing.result = convertedInteger(result);
+      vm->pop(5);
+      vm->pushInteger(result);
+      return;}
+
     /* Prepare the socket for a non-blocking send(). */
     result = ioctl(
 		   socketPointer->resource.handle,
@@ -855,6 +2059,11 @@ void nextPutFromToTCPSocketStartingAt(void) {
 		  vm->stackIntegerValue(3),
 		  0);
 
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.writing,
+		  result,
+		  wouldHaveBlocked(result));
     if ((result == -1) && (lastError() == EWOULDBLOCK)) {
       /*
        * We ought to have been able to send at least one
@@ -874,6 +2083,99 @@ void nextPutFromToTCPSocketStartingAt(void) {
     vm->pushInteger(result);}}
 
 
+void nextPutVectorToTCPSocket(void) {
+  /*
+   * nextPutVector: regionsArray
+   * to: tcpSocketHandle
+   */
+
+  /*
+   * Send several regions, each given in the Array as a ByteArray
+   * (or String), a start index and a length, with one system call.
+   * Answer the total number of bytes sent. The regions are sent in
+   * order, so after a partial send, the total tells how far it got.
+   */
+
+#ifdef UNIXISH
+  flowSocket   *socketPointer = (flowSocket *) (addressForStackValue(0));
+  int	       regions = vm->stackObjectValue(1);
+  struct iovec vector[MaximumVectorLength];
+  char	       *gathered;
+  int	       count, index, total, taken, wouldBlock;
+  ssize_t      result;
+  int	       nonblocking = TRUE;
+
+
+  if (!(vm->failed())) {
+    if ((count = readVector(regions, vector)) < 0) {
+      vm->primitiveFail();
+      return;}
+
+    corkUntilBoundary(socketPointer);
+    if (socketPointer->resource.model == completionRingModel) {
+      /* The ring copies sends out anyway; gather them as it does. */
+      for (total = 0, index = 0; index < count; index++) total += vector[index].iov_len;
+      if ((gathered = (char *) malloc(total > 0 ? total : 1)) == NULL) {
+	vm->primitiveFail();
+	return;}
+      for (total = 0, index = 0; index < count; index++) {
+	memcpy(gathered + total, vector[index].iov_base, vector[index].iov_len);
+	total += vector[index].iov_len;}
+      result = queueSend(
+			 &socketPointer->resource,
+			 gathered,
+			 total);
+      wouldBlock = wouldHaveBlocked(result);
+      free(gathered);}
+    else if (socketPointer->resource.sendQueue != NULL) {
+      /* Queue each region in turn, until the queue is full. */
+      result = 0;
+      for (index = 0; index < count; index++) {
+	taken = queueBytesToSend(
+				 &socketPointer->resource,
+				 (char *) vector[index].iov_base,
+				 vector[index].iov_len);
+	if (taken == -1) {
+	  if (result == 0) result = -1;
+	  break;}
+	result += taken;
+	if (taken < vector[index].iov_len) break;}
+      /* A full queue takes nothing, rather than failing. */
+      wouldBlock = (result == 0) && (index < count);}
+    else {
+      /* Prepare the socket for a non-blocking send, as nextPut:... does. */
+      if (ioctl(
+		socketPointer->resource.handle,
+		FIONBIO,
+		&nonblocking)
+	  == -1) {
+	vm->primitiveFail();
+	return;}
+
+      result = writev(
+		      socketPointer->resource.handle,
+		      vector,
+		      count);
+      wouldBlock = wouldHaveBlocked(result);}
+
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.writing,
+		  result,
+		  wouldBlock);
+    if (result == -1) {
+      vm->primitiveFail();
+      return;}
+
+    socketPointer->resource.writing.result = convertedInteger(result);
+    vm->pop(3);
+    vm->pushInteger(result);}
+#else
+  vm->primitiveFail();
+#endif
+}
+
+
 void tcpSocketIsActive(void) {
   /* isActive: socketHandle */
 
@@ -891,6 +2193,173 @@ void tcpSocketIsActive(void) {
 		      vm->trueObject());}}
 
 
+void spinOnSocketForMicrosecondsBusyPolling(void) {
+  /*
+   * spinOn: socketHandle
+   * forMicroseconds: budget
+   * busyPolling: aBoolean
+   */
+
+  /*
+   * Put the socket's scribing threads in low-latency mode: each
+   * polls for up to the given number of microseconds, for requests
+   * and for readiness, before blocking. A budget of zero turns it
+   * off. When busyPolling is true, and the platform supports it,
+   * the kernel also busy-polls the device queue for the socket
+   * (SO_BUSY_POLL, which may need privileges to raise).
+   */
+
+  flowSocket *socketPointer = (flowSocket *) (addressForStackValue(2));
+  int	     budget = vm->stackIntegerValue(1);
+  int	     busyPolling = vm->stackValue(0);
+#ifdef SO_BUSY_POLL
+  int	     busyPollBudget;
+#endif
+
+
+  if (!(vm->failed())) {
+    if ((budget < 0)
+	|| (socketPointer->resource.model != scribingThreadsModel)
+	|| ((busyPolling != vm->trueObject()) && (busyPolling != vm->falseObject()))) {
+      vm->primitiveFail();
+      return;}
+
+#ifdef SO_BUSY_POLL
+    busyPollBudget = (busyPolling == vm->trueObject()) ? budget : 0;
+    if ((setsockopt(
+		    socketPointer->resource.handle,
+		    SOL_SOCKET,
+		    SO_BUSY_POLL,
+		    &busyPollBudget,
+		    sizeof(busyPollBudget))
+	 < 0)
+	&& (busyPollBudget > 0)) {
+      vm->primitiveFail();
+      return;}
+#else
+    if (busyPolling == vm->trueObject()) {
+      vm->primitiveFail();
+      return;}
+#endif
+
+    socketPointer->resource.reading.spinBudget = budget;
+    socketPointer->resource.writing.spinBudget = budget;
+    vm->pop(3);}}
+
+
+void spinStatisticsForSocketInto(void) {
+  /*
+   * spinStatisticsFor: socketHandle
+   * into: thirtyTwoByteArray
+   */
+
+  /*
+   * Write how often reading spins for socket readiness found it, how
+   * often they gave up and blocked, and the same for writing; then
+   * the same for the scribing threads' spins waiting for requests
+   * from the VM, as eight four-byte integers.
+   */
+
+  flowSocket   *socketPointer = (flowSocket *) (addressForStackValue(1));
+  int	       statistics = vm->stackObjectValue(0);
+  unsigned int counts[8];
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(statistics) == (vm->classByteArray()))
+	|| (vm->byteSizeOf(statistics) < sizeof(counts))) {
+      vm->primitiveFail();
+      return;}
+
+    counts[0] = socketPointer->resource.reading.spinsSatisfied;
+    counts[1] = socketPointer->resource.reading.spinsExhausted;
+    counts[2] = socketPointer->resource.writing.spinsSatisfied;
+    counts[3] = socketPointer->resource.writing.spinsExhausted;
+    counts[4] = socketPointer->resource.reading.requestSpinsSatisfied;
+    counts[5] = socketPointer->resource.reading.requestSpinsExhausted;
+    counts[6] = socketPointer->resource.writing.requestSpinsSatisfied;
+    counts[7] = socketPointer->resource.writing.requestSpinsExhausted;
+    memcpy(
+	   (void *) (statistics + BaseHeaderSize),
+	   counts,
+	   sizeof(counts));
+    vm->pop(2);}}
+
+
+void statisticsForTCPSocketInto(void) {
+  /*
+   * statisticsFor: socketHandle
+   * into: sixtyByteArray
+   */
+
+  /*
+   * Write what flow has counted for the socket: bytes received and
+   * sent, and the total microseconds from readiness signals to the
+   * calls which followed them, as eight-byte integers; then calls of
+   * the reading and writing primitives (framed, zero-copy and UDP
+   * ones included), how many of those found nothing to do, readiness
+   * waits, and signals followed by calls, as four-byte integers.
+   * Then write what the kernel knows of the connection, as
+   * four-byte integers: the smoothed round-trip time and its
+   * variation in microseconds, the congestion window in segments,
+   * the total segments retransmitted, and the segments sent but not
+   * yet acknowledged. Those are zero where TCP_INFO isn't available.
+   *
+   * The mean delay from signal to call tells whether a slow
+   * connection is waiting on the network or on the image's
+   * processes.
+   */
+
+  flowSocket	     *socketPointer = (flowSocket *) (addressForStackValue(1));
+  int		     statistics = vm->stackObjectValue(0);
+  unsigned long long totals[3];
+  unsigned int	     counts[9];
+#ifdef LINUXISH
+  struct tcp_info    information;
+  socklen_t	     size = sizeof(information);
+#endif
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(statistics) == (vm->classByteArray()))
+	|| (vm->byteSizeOf(statistics) < (sizeof(totals) + sizeof(counts)))) {
+      vm->primitiveFail();
+      return;}
+
+    totals[0] = socketPointer->bytesIn;
+    totals[1] = socketPointer->bytesOut;
+    totals[2] = socketPointer->signalDelay;
+    counts[0] = socketPointer->calls;
+    counts[1] = socketPointer->wouldBlocks;
+    counts[2] = socketPointer->waits;
+    counts[3] = socketPointer->signalsTaken;
+    memset(&counts[4], 0, 5 * sizeof(counts[0]));
+#ifdef LINUXISH
+    if (getsockopt(
+		   socketPointer->resource.handle,
+		   IPPROTO_TCP,
+		   TCP_INFO,
+		   &information,
+		   &size)
+	== 0) {
+      counts[4] = information.tcpi_rtt;
+      counts[5] = information.tcpi_rttvar;
+      counts[6] = information.tcpi_snd_cwnd;
+      counts[7] = information.tcpi_total_retrans;
+      counts[8] = information.tcpi_unacked;}
+#endif
+
+    memcpy(
+	   (void *) (statistics + BaseHeaderSize),
+	   totals,
+	   sizeof(totals));
+    memcpy(
+	   (void *) (statistics + BaseHeaderSize + sizeof(totals)),
+	   counts,
+	   sizeof(counts));
+    vm->pop(2);}}
+
+
 void nextPacketFromUDPSocketInto(void) {
   /*
    * nextPacketFrom: udpSocketHandle
@@ -918,6 +2387,11 @@ void nextPacketFromUDPSocketInto(void) {
 		      &addressSize);
 
     socketPointer->resource.reading.result = convertedInteger(result);
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.reading,
+		  result,
+		  wouldHaveBlocked(result));
     if (socketPointer->resource.reading.result == timeout)
       result = result;
     if (result == -1) {
@@ -960,6 +2434,11 @@ void nextPacketFromUDPSocketIntoAddressInto(void) {
 		      &addressSize);
 
     socketPointer->resource.reading.result = convertedInteger(result);
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.reading,
+		  result,
+		  wouldHaveBlocked(result));
     if (socketPointer->resource.reading.result == timeout)
       result = result;
 
@@ -1020,6 +2499,11 @@ void sendPacketFromUDPSocketToAddress(void) {
 		    (struct sockaddr *) &address,
 		    addressSize);
 
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.writing,
+		  result,
+		  wouldHaveBlocked(result));
     if (result == -1) result = lastError();
 	  
     socketPointer->resource.writing.result = convertedInteger(result);
@@ -1027,6 +2511,489 @@ void sendPacketFromUDPSocketToAddress(void) {
     vm->pushInteger(result);}}
 
 
+void nextPacketFromUDPSocketIntoStartingAtCountAddressInto(void) {
+  /*
+   * nextPacketFrom: udpSocketHandle
+   * into: packetByteArray
+   * startingAt: startIndex
+   * count: maximumBytes
+   * addressInto: addressBytes
+   */
+
+  /*
+   * Receive a datagram into part of a (possibly large) ByteArray,
+   * so that the image can receive into a ring buffer in place.
+   * Answer the number of bytes received.
+   */
+
+  flowSocket	     *socketPointer = (flowSocket *) (addressForStackValue(4));
+  int		     packet = vm->stackObjectValue(3);
+  int		     start = vm->stackIntegerValue(2);
+  int		     count = vm->stackIntegerValue(1);
+  int		     sourceAddress = vm->stackObjectValue(0);
+  struct sockaddr_in address;
+  socklen_t	     addressSize = sizeof(address);
+  int		     result;
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(sourceAddress) == (vm->classByteArray()))
+	|| (vm->byteSizeOf(sourceAddress) < 6)
+	|| !(vm->isWordsOrBytes(packet))
+	|| (start < 1)
+	|| (count < 0)
+	|| ((start - 1 + count) > vm->byteSizeOf(packet))) {
+      vm->primitiveFail();
+      return;}
+
+    result = recvfrom(
+		      socketPointer->resource.handle,
+		      (char *) (packet + BaseHeaderSize + start - 1),
+		      count,
+		      0,
+		      (struct sockaddr *) &address,
+		      &addressSize);
+    socketPointer->resource.reading.result = convertedInteger(result);
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.reading,
+		  result,
+		  wouldHaveBlocked(result));
+    if (result == -1) {
+      vm->primitiveFail();
+      return;}
+
+    writeAddressBytes(&address, (char *) (sourceAddress + BaseHeaderSize));
+    vm->pop(6);
+    vm->pushInteger(result);}}
+
+
+void sendPacketStartingAtCountFromUDPSocketToAddress(void) {
+  /*
+   * sendPacket: packetByteArray
+   * startingAt: startIndex
+   * count: numberOfBytes
+   * from: udpSocketHandle
+   * toAddress: addressBytes
+   */
+
+  /*
+   * Send part of a (possibly large) ByteArray as a datagram, so
+   * that the image can assemble packets in place. Answer the number
+   * of bytes sent.
+   */
+
+  int		     packet = vm->stackObjectValue(4);
+  int		     start = vm->stackIntegerValue(3);
+  int		     count = vm->stackIntegerValue(2);
+  flowSocket	     *socketPointer = (flowSocket *) (addressForStackValue(1));
+  int		     addressBytes = vm->stackObjectValue(0);
+  struct sockaddr_in address;
+  int		     result;
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(addressBytes) == (vm->classByteArray()))
+	|| (vm->byteSizeOf(addressBytes) < 6)
+	|| !(vm->isWordsOrBytes(packet))
+	|| (start < 1)
+	|| (count < 0)
+	|| ((start - 1 + count) > vm->byteSizeOf(packet))) {
+      vm->primitiveFail();
+      return;}
+
+    readAddressBytes((char *) (addressBytes + BaseHeaderSize), &address);
+    result = sendto(
+		    socketPointer->resource.handle,
+		    (char *) (packet + BaseHeaderSize + start - 1),
+		    count,
+		    0,
+		    (struct sockaddr *) &address,
+		    sizeof(address));
+    socketPointer->resource.writing.result = convertedInteger(result);
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.writing,
+		  result,
+		  wouldHaveBlocked(result));
+    if (result == -1) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(6);
+    vm->pushInteger(result);}}
+
+
+void nextPacketsFromUDPSocketUpToInto(void) {
+  /*
+   * nextPacketsFrom: udpSocketHandle
+   * upTo: maximumPackets
+   * into: packetsByteArray
+   */
+
+  /*
+   * Receive up to the given number of datagrams with one system
+   * call, waiting only for the first. The ByteArray is divided into
+   * that many equal slots; each datagram received goes into the
+   * next slot, after its four-byte length, its six-byte source
+   * address (as from nextPacketFrom:into:addressInto:) and two
+   * bytes of padding. Answer how many datagrams were received.
+   */
+
+#ifdef LINUXISH
+  flowSocket	     *socketPointer = (flowSocket *) (addressForStackValue(2));
+  int		     maximum = vm->stackIntegerValue(1);
+  int		     packets = vm->stackObjectValue(0);
+  struct mmsghdr     messages[MaximumPacketBatch];
+  struct iovec	     vector[MaximumPacketBatch];
+  struct sockaddr_in addresses[MaximumPacketBatch];
+  char		     *slot;
+  int		     slotSize, index, result, moved;
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(packets) == (vm->classByteArray()))
+	|| (maximum < 1)
+	|| (maximum > MaximumPacketBatch)) {
+      vm->primitiveFail();
+      return;}
+
+    slotSize = vm->byteSizeOf(packets) / maximum;
+    if (slotSize <= ReceivedPacketHeaderSize) {
+      vm->primitiveFail();
+      return;}
+
+    memset(messages, 0, maximum * sizeof(struct mmsghdr));
+    for (index = 0; index < maximum; index++) {
+      slot = (char *) (packets + BaseHeaderSize + (index * slotSize));
+      vector[index].iov_base = slot + ReceivedPacketHeaderSize;
+      vector[index].iov_len = slotSize - ReceivedPacketHeaderSize;
+      messages[index].msg_hdr.msg_iov = &vector[index];
+      messages[index].msg_hdr.msg_iovlen = 1;
+      messages[index].msg_hdr.msg_name = &addresses[index];
+      messages[index].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);}
+
+    result = recvmmsg(
+		      socketPointer->resource.handle,
+		      messages,
+		      maximum,
+		      MSG_WAITFORONE,
+		      NULL);
+    socketPointer->resource.reading.result = convertedInteger(result);
+    for (moved = 0, index = 0; index < result; index++) moved += messages[index].msg_len;
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.reading,
+		  (result == -1) ? -1 : moved,
+		  wouldHaveBlocked(result));
+    if (result == -1) {
+      vm->primitiveFail();
+      return;}
+
+    for (index = 0; index < result; index++) {
+      slot = (char *) (packets + BaseHeaderSize + (index * slotSize));
+      memcpy(
+	     slot,
+	     &messages[index].msg_len,
+	     4);
+      writeAddressBytes(&addresses[index], slot + 4);
+      memset(slot + 10, 0, 2);}
+
+    vm->pop(4);
+    vm->pushInteger(result);}
+#else
+  vm->primitiveFail();
+#endif
+}
+
+
+void sendPacketsFromUDPSocketDescribedBy(void) {
+  /*
+   * sendPackets: packetsByteArray
+   * from: udpSocketHandle
+   * describedBy: descriptorsByteArray
+   */
+
+  /*
+   * Send several datagrams from one ByteArray with one system call.
+   * The descriptors hold, for each datagram, its four-byte start
+   * index and length in the packets ByteArray, then its six-byte
+   * destination address (as for sendPacket:from:toAddress:) and two
+   * bytes of padding. Answer how many datagrams were sent.
+   */
+
+#ifdef LINUXISH
+  int		     packets = vm->stackObjectValue(2);
+  flowSocket	     *socketPointer = (flowSocket *) (addressForStackValue(1));
+  int		     descriptors = vm->stackObjectValue(0);
+  struct mmsghdr     messages[MaximumPacketBatch];
+  struct iovec	     vector[MaximumPacketBatch];
+  struct sockaddr_in addresses[MaximumPacketBatch];
+  char		     *descriptor;
+  int		     count, index, start, length, result, moved;
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(descriptors) == (vm->classByteArray()))
+	|| !(vm->isWordsOrBytes(packets))) {
+      vm->primitiveFail();
+      return;}
+
+    count = vm->byteSizeOf(descriptors) / PacketDescriptorSize;
+    if ((count < 1) || (count > MaximumPacketBatch)) {
+      vm->primitiveFail();
+      return;}
+
+    memset(messages, 0, count * sizeof(struct mmsghdr));
+    for (index = 0; index < count; index++) {
+      descriptor = (char *) (descriptors + BaseHeaderSize + (index * PacketDescriptorSize));
+      memcpy(&start, descriptor, 4);
+      memcpy(&length, descriptor + 4, 4);
+      /* Raw four-byte values, not SmallIntegers; compare without adding. */
+      if ((start < 1)
+	  || (length < 0)
+	  || ((start - 1) > vm->byteSizeOf(packets))
+	  || (length > (vm->byteSizeOf(packets) - (start - 1)))) {
+	vm->primitiveFail();
+	return;}
+
+      readAddressBytes(descriptor + 8, &addresses[index]);
+      vector[index].iov_base = (char *) (packets + BaseHeaderSize + start - 1);
+      vector[index].iov_len = length;
+      messages[index].msg_hdr.msg_iov = &vector[index];
+      messages[index].msg_hdr.msg_iovlen = 1;
+      messages[index].msg_hdr.msg_name = &addresses[index];
+      messages[index].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);}
+
+    result = sendmmsg(
+		      socketPointer->resource.handle,
+		      messages,
+		      count,
+		      0);
+    socketPointer->resource.writing.result = convertedInteger(result);
+    for (moved = 0, index = 0; index < result; index++) moved += messages[index].msg_len;
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.writing,
+		  (result == -1) ? -1 : moved,
+		  wouldHaveBlocked(result));
+    if (result == -1) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(4);
+    vm->pushInteger(result);}
+#else
+  vm->primitiveFail();
+#endif
+}
+
+
+void sendPacketFromUDPSocketToAddressInSegmentsOf(void) {
+  /*
+   * sendPacket: packetByteArray
+   * from: udpSocketHandle
+   * toAddress: addressBytes
+   * inSegmentsOf: segmentSize
+   */
+
+  /*
+   * Send the whole ByteArray as a run of datagrams of the given
+   * size (the last may be shorter), handing it to the kernel once
+   * and letting it (or the network device) do the segmentation
+   * (UDP_SEGMENT). Answer the number of bytes sent.
+   */
+
+#ifdef UDP_SEGMENT
+  int		     packetBytes = vm->stackObjectValue(3);
+  flowSocket	     *socketPointer = (flowSocket *) (addressForStackValue(2));
+  int		     addressBytes = vm->stackObjectValue(1);
+  int		     segmentSize = vm->stackIntegerValue(0);
+  struct sockaddr_in address;
+  struct msghdr	     message;
+  struct iovec	     vector;
+  struct cmsghdr     *control;
+  char		     controlBytes[CMSG_SPACE(sizeof(unsigned short))];
+  unsigned short     size;
+  int		     result;
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(addressBytes) == (vm->classByteArray()))
+	|| (vm->byteSizeOf(addressBytes) < 6)
+	|| !(vm->isWordsOrBytes(packetBytes))
+	|| (segmentSize < 1)
+	|| (segmentSize > 65535)) {
+      vm->primitiveFail();
+      return;}
+
+    readAddressBytes((char *) (addressBytes + BaseHeaderSize), &address);
+    vector.iov_base = (char *) (packetBytes + BaseHeaderSize);
+    vector.iov_len = vm->byteSizeOf(packetBytes);
+
+    memset(&message, 0, sizeof(message));
+    memset(controlBytes, 0, sizeof(controlBytes));
+    message.msg_name = &address;
+    message.msg_namelen = sizeof(address);
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = controlBytes;
+    message.msg_controllen = sizeof(controlBytes);
+
+    size = segmentSize;
+    control = CMSG_FIRSTHDR(&message);
+    control->cmsg_level = SOL_UDP;
+    control->cmsg_type = UDP_SEGMENT;
+    control->cmsg_len = CMSG_LEN(sizeof(size));
+    memcpy(CMSG_DATA(control), &size, sizeof(size));
+
+    result = sendmsg(
+		     socketPointer->resource.handle,
+		     &message,
+		     0);
+    socketPointer->resource.writing.result = convertedInteger(result);
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.writing,
+		  result,
+		  wouldHaveBlocked(result));
+    if (result == -1) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(5);
+    vm->pushInteger(result);}
+#else
+  vm->primitiveFail();
+#endif
+}
+
+
+void coalescePacketsForUDPSocket(void) {
+  /*
+   * coalescePackets: aBoolean
+   * forUDPSocket: udpSocketHandle
+   */
+
+  /*
+   * Let the kernel coalesce datagrams received by the socket from
+   * the same sender into larger buffers (UDP_GRO), to be read with
+   * nextCoalescedPacketsFrom:into:addressInto:segmentSizeInto:.
+   */
+
+#ifdef UDP_GRO
+  int	     enabled = vm->stackValue(1);
+  flowSocket *socketPointer = (flowSocket *) (addressForStackValue(0));
+  int	     on;
+
+
+  if (!(vm->failed())) {
+    if (enabled == vm->trueObject())
+      on = 1;
+    else if (enabled == vm->falseObject())
+      on = 0;
+    else {
+      vm->primitiveFail();
+      return;}
+
+    if (setsockopt(
+		   socketPointer->resource.handle,
+		   SOL_UDP,
+		   UDP_GRO,
+		   &on,
+		   sizeof(on))
+	< 0) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(2);}
+#else
+  vm->primitiveFail();
+#endif
+}
+
+
+void nextCoalescedPacketsFromUDPSocketIntoAddressIntoSegmentSizeInto(void) {
+  /*
+   * nextCoalescedPacketsFrom: udpSocketHandle
+   * into: packetByteArray
+   * addressInto: addressBytes
+   * segmentSizeInto: fourByteArray
+   */
+
+  /*
+   * Receive what may be several coalesced datagrams from one
+   * sender. Answer the number of bytes received, and write the
+   * size of each datagram in it (all but the last are that size;
+   * the last may be shorter) into the four-byte ByteArray.
+   */
+
+#ifdef UDP_GRO
+  flowSocket	     *socketPointer = (flowSocket *) (addressForStackValue(3));
+  int		     packet = vm->stackObjectValue(2);
+  int		     sourceAddress = vm->stackObjectValue(1);
+  int		     segmentSizeBytes = vm->stackObjectValue(0);
+  struct sockaddr_in address;
+  struct msghdr	     message;
+  struct iovec	     vector;
+  struct cmsghdr     *control;
+  char		     controlBytes[CMSG_SPACE(sizeof(int))];
+  int		     result, segmentSize;
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(sourceAddress) == (vm->classByteArray()))
+	|| (vm->byteSizeOf(sourceAddress) < 6)
+	|| !(vm->fetchClassOf(segmentSizeBytes) == (vm->classByteArray()))
+	|| (vm->byteSizeOf(segmentSizeBytes) < 4)
+	|| !(vm->isWordsOrBytes(packet))) {
+      vm->primitiveFail();
+      return;}
+
+    vector.iov_base = (char *) (packet + BaseHeaderSize);
+    vector.iov_len = vm->byteSizeOf(packet);
+    memset(&message, 0, sizeof(message));
+    message.msg_name = &address;
+    message.msg_namelen = sizeof(address);
+    message.msg_iov = &vector;
+    message.msg_iovlen = 1;
+    message.msg_control = controlBytes;
+    message.msg_controllen = sizeof(controlBytes);
+
+    result = recvmsg(
+		     socketPointer->resource.handle,
+		     &message,
+		     0);
+    socketPointer->resource.reading.result = convertedInteger(result);
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.reading,
+		  result,
+		  wouldHaveBlocked(result));
+    if (result == -1) {
+      vm->primitiveFail();
+      return;}
+
+    /* Without coalescing, there's just the one datagram. */
+    segmentSize = result;
+    for (control = CMSG_FIRSTHDR(&message); control != NULL; control = CMSG_NXTHDR(&message, control))
+      if ((control->cmsg_level == SOL_UDP) && (control->cmsg_type == UDP_GRO))
+	memcpy(&segmentSize, CMSG_DATA(control), sizeof(segmentSize));
+
+    writeAddressBytes(&address, (char *) (sourceAddress + BaseHeaderSize));
+    memcpy(
+	   (char *) (segmentSizeBytes + BaseHeaderSize),
+	   &segmentSize,
+	   4);
+
+    vm->pop(5);
+    vm->pushInteger(result);}
+#else
+  vm->primitiveFail();
+#endif
+}
+
+
 void closeSocket(void) {
   /* close: socketHandle */
 
@@ -1038,8 +3005,8 @@ void closeSocket(void) {
       vm->primitiveFail();
       return;}
     else {
-      killThread(&socketPointer->resource.reading.sync);
-      killThread(&socketPointer->resource.writing.sync);
+      forgetCorkedSocket(socketPointer);
+      stopScribing(&socketPointer->resource);
       close(socketPointer->resource.handle);
       free((void *) socketPointer);
       socketPointer->state = flowClosed;
@@ -0,0 +1,789 @@
+/*
+ * flow: a Smalltalk streaming framework
+ * version 3
+ *
+ * pipeline.c - transforming bytes between resources without the VM
+ *
+ * Craig Latta
+ * netjam.org/flow
+ */
+
+/*
+ * A proxy forwards bytes untouched. Often a stream wants some work
+ * done on the way, though: a checksum over everything sent, a cap on
+ * its rate, a length prefix on each message, or compression. A
+ * pipeline is a proxy with stages. Its thread reads a chunk from the
+ * source (a socket, or a file), passes it through each stage in turn,
+ * and writes what comes out to the destination (a socket, or a file).
+ * A stage which changes bytes writes them into a buffer of its own,
+ * and hands each piece it makes to the next stage as it's made; a
+ * stage which leaves its input alone doesn't copy it at all. As with
+ * a proxy, the pipeline's semaphore is signalled when the source
+ * ends, or moving fails, and the image can read the pipeline's
+ * progress, and its checksum, at any time.
+ *
+ * Stages are added before the pipeline starts, in the order bytes
+ * should pass through them. A framing stage makes each piece it's
+ * given a frame of its own, so the destination's reader can use a
+ * length-prefixed receive queue to take whole messages. When the
+ * source ends, compression stages finish their streams.
+ */
+
+#include "flow.h"
+extern struct VirtualMachine *vm;
+
+#ifdef LINUXISH
+
+/* the CRC-32 (as in zlib and Ethernet) of each byte value */
+static unsigned int	crcTable[256];
+static pthread_once_t	crcTableMade = PTHREAD_ONCE_INIT;
+
+
+/*
+ * utilities
+ */
+
+static void makeCRCTable(void) {
+  unsigned int value;
+  int	       index, bit;
+
+
+  for (index = 0; index < 256; index++) {
+    value = index;
+    for (bit = 0; bit < 8; bit++)
+      value = (value & 1) ? (0xEDB88320 ^ (value >> 1)) : (value >> 1);
+    crcTable[index] = value;}}
+
+
+static unsigned int updatedChecksum(
+				    unsigned int checksum,
+				    char	 *bytes,
+				    int		 count) {
+  unsigned int value = ~checksum;
+  int	       index;
+
+
+  for (index = 0; index < count; index++)
+    value = crcTable[(value ^ (unsigned char) bytes[index]) & 0xFF] ^ (value >> 8);
+
+  return ~value;}
+
+
+static int throttle(
+		    pipeline	  *pipelinePointer,
+		    pipelineStage *stage,
+		    int		  count) {
+  /*
+   * Wait until the stage's rate allows count more bytes to pass.
+   * Answer FALSE if the pipeline was closed meanwhile.
+   */
+
+  long long now = monotonicMicroseconds();
+  long long delay;
+
+
+  if (stage->nextRelease < now) stage->nextRelease = now;
+  delay = stage->nextRelease - now;
+  if ((delay > 0)
+      && !waitUnlessWoken(
+			  -1,
+			  0,
+			  pipelinePointer->wakeup,
+			  (int) ((delay + 999) / 1000)))
+    return FALSE;
+
+  stage->nextRelease += ((long long) count * 1000000) / stage->bytesPerSecond;
+  return TRUE;}
+
+
+static int deliver(
+		   pipeline *pipelinePointer,
+		   char	    *data,
+		   int	    count);
+static int runStages(
+		     pipeline *pipelinePointer,
+		     int      first,
+		     char     *data,
+		     int      count,
+		     int      ending);
+
+
+static int largestFrame(pipelineStage *stage) {
+  return (stage->lengthWidth == 4) ? PipelineChunkSize : ((1 << (stage->lengthWidth * 8)) - 1);}
+
+
+static int frame(
+		 pipeline *pipelinePointer,
+		 int	  index,
+		 char	  *data,
+		 int	  count,
+		 int	  ending) {
+  /*
+   * Prefix the bytes with their length, as one frame or (if they're
+   * too many for the prefix) several, and pass each frame on.
+   */
+
+  pipelineStage *stage = &pipelinePointer->stages[index];
+  int		piece, byte, result;
+
+
+  while (count > 0) {
+    piece = (count < largestFrame(stage)) ? count : largestFrame(stage);
+    for (byte = 0; byte < stage->lengthWidth; byte++)
+      stage->output[stage->bigEndian ? (stage->lengthWidth - 1 - byte) : byte] =
+	(char) ((piece >> (byte * 8)) & 0xFF);
+    memcpy(
+	   stage->output + stage->lengthWidth,
+	   data,
+	   piece);
+    result = runStages(
+		       pipelinePointer,
+		       index + 1,
+		       stage->output,
+		       piece + stage->lengthWidth,
+		       FALSE);
+    if (result != ready) return result;
+    data += piece;
+    count -= piece;}
+
+  return ending ? runStages(pipelinePointer, index + 1, NULL, 0, TRUE) : ready;}
+
+
+static int code(
+		pipeline *pipelinePointer,
+		int	 index,
+		char	 *data,
+		int	 count,
+		int	 ending) {
+  /* Compress or decompress the bytes, passing each piece of output on as it's made. */
+
+  pipelineStage *stage = &pipelinePointer->stages[index];
+  codec		*codecPointer = stage->codec;
+  int		flush = codecContinue;
+  int		available, produced, result;
+
+
+  if (stage->kind == compressionStage) {
+    codecPointer->sinceFlush += count;
+    if (ending)
+      flush = codecFinish;
+    else if ((codecPointer->flushEvery == 0) || (codecPointer->sinceFlush >= codecPointer->flushEvery))
+      flush = codecFlush;}
+
+  do {
+    available = count;
+    produced = runCodec(
+			codecPointer,
+			&data,
+			&count,
+			stage->output,
+			stage->outputSize,
+			flush);
+    if (produced < 0) {
+      errno = EBADMSG;
+      return error;}
+    if ((produced > 0)
+	&& ((result = runStages(pipelinePointer, index + 1, stage->output, produced, FALSE)) != ready))
+      return result;}
+  while ((produced > 0) || ((count > 0) && (count < available)));
+
+  if (flush != codecContinue) codecPointer->sinceFlush = 0;
+  return ending ? runStages(pipelinePointer, index + 1, NULL, 0, TRUE) : ready;}
+
+
+static int runStages(
+		     pipeline *pipelinePointer,
+		     int      first,
+		     char     *data,
+		     int      count,
+		     int      ending) {
+  /*
+   * Pass the bytes through the stages from the first given, and
+   * write what comes out. When the source has ended, there are no
+   * bytes, but stages may have some of their own to finish with.
+   * Answer ready, error, or zero if the pipeline was closed.
+   */
+
+  pipelineStage *stage;
+  int		index;
+
+
+  for (index = first; index < pipelinePointer->numberOfStages; index++) {
+    stage = &pipelinePointer->stages[index];
+    switch (stage->kind) {
+    case checksumStage:
+      __atomic_store_n(
+		       &stage->checksum,
+		       updatedChecksum(stage->checksum, data, count),
+		       __ATOMIC_RELAXED);
+      break;
+    case rateLimitStage:
+      if (!throttle(pipelinePointer, stage, count)) return 0;
+      break;
+    case framingStage:
+      return frame(pipelinePointer, index, data, count, ending);
+    case compressionStage:
+    case decompressionStage:
+      return code(pipelinePointer, index, data, count, ending);}}
+
+  return deliver(pipelinePointer, data, count);}
+
+
+static int deliver(
+		   pipeline *pipelinePointer,
+		   char	    *data,
+		   int	    count) {
+  /* Answer ready when everything is written, error if writing fails, or zero if the pipeline was closed. */
+
+  ssize_t written;
+
+
+  while (count > 0) {
+    if (!waitUnlessWoken(pipelinePointer->destination, POLLOUT, pipelinePointer->wakeup, -1)) return 0;
+    written = write(
+		    pipelinePointer->destination,
+		    data,
+		    count);
+    if (written < 0) {
+      if ((errno == EAGAIN) || (errno == EINTR)) continue;
+      return error;}
+
+    data += written;
+    count -= written;
+    __atomic_add_fetch(&pipelinePointer->bytesOut, written, __ATOMIC_RELAXED);}
+
+  return ready;}
+
+
+static int pump(pipeline *pipelinePointer) {
+  /* Answer ready when the source ends, error if moving fails, or zero if the pipeline was closed. */
+
+  ssize_t count;
+  int	  result;
+
+
+  for(;;) {
+    /* Regular files always poll ready, but this notices closing. */
+    if (!waitUnlessWoken(pipelinePointer->source, POLLIN, pipelinePointer->wakeup, -1)) return 0;
+    count = pipelinePointer->sourceIsFile
+      ? pread(
+	      pipelinePointer->source,
+	      pipelinePointer->input,
+	      pipelinePointer->chunkSize,
+	      pipelinePointer->offset)
+      : read(
+	     pipelinePointer->source,
+	     pipelinePointer->input,
+	     pipelinePointer->chunkSize);
+    if (count == 0)
+      return runStages(
+		       pipelinePointer,
+		       0,
+		       NULL,
+		       0,
+		       TRUE);
+    if (count < 0) {
+      if ((errno == EAGAIN) || (errno == EINTR)) continue;
+      return error;}
+
+    pipelinePointer->offset += count;
+    __atomic_add_fetch(&pipelinePointer->bytesIn, count, __ATOMIC_RELAXED);
+
+    result = runStages(
+		       pipelinePointer,
+		       0,
+		       pipelinePointer->input,
+		       count,
+		       FALSE);
+    if (result != ready) return result;}}
+
+
+/*
+ * thread functions
+ */
+
+/* Move bytes through the stages until the source ends, moving fails, or the pipeline is closed. */
+void pumpPipeline(void *parameter) {
+  pipeline *pipelinePointer = (pipeline *) parameter;
+  int	   result;
+
+
+  result = pump(pipelinePointer);
+  if (result == 0) return;
+
+  if (result == error)
+    __atomic_store_n(&pipelinePointer->errorNumber, errno, __ATOMIC_RELAXED);
+  __atomic_store_n(&pipelinePointer->result, result, __ATOMIC_RELEASE);
+  synchronizedSignalSemaphoreWithIndex(pipelinePointer->sync.semaphore);}
+
+
+static void freeBuffers(pipeline *pipelinePointer) {
+  int index;
+
+
+  for (index = 0; index < pipelinePointer->numberOfStages; index++) {
+    free(pipelinePointer->stages[index].output);
+    pipelinePointer->stages[index].output = NULL;}
+  free(pipelinePointer->input);
+  pipelinePointer->input = NULL;}
+
+
+static int startPipeline(pipeline *pipelinePointer) {
+  /*
+   * The source and destination have been set already, and any socket
+   * among them made nonblocking.
+   */
+
+  pipelineStage *stage;
+  int		index, largest, allocated = TRUE;
+
+
+  pthread_once(&crcTableMade, makeCRCTable);
+
+  /* Give each stage which changes bytes room for the most it can be handed at once. */
+  pipelinePointer->chunkSize = largest = PipelineChunkSize;
+  for (index = 0; index < pipelinePointer->numberOfStages; index++) {
+    stage = &pipelinePointer->stages[index];
+    stage->checksum = 0;
+    stage->nextRelease = 0;
+    switch (stage->kind) {
+    case framingStage:
+      if (largest > largestFrame(stage)) largest = largestFrame(stage);
+      largest = stage->outputSize = largest + stage->lengthWidth;
+      break;
+    case compressionStage:
+      largest = stage->outputSize = codecBound(stage->codec, PipelineChunkSize);
+      break;
+    case decompressionStage:
+      largest = stage->outputSize = PipelineChunkSize;
+      break;}
+    if ((stage->outputSize > 0)
+	&& ((stage->output = (char *) malloc(stage->outputSize)) == NULL))
+      allocated = FALSE;}
+
+  pipelinePointer->input = (char *) malloc(PipelineChunkSize);
+  pipelinePointer->bytesIn = 0;
+  pipelinePointer->bytesOut = 0;
+  pipelinePointer->result = 0;
+  pipelinePointer->errorNumber = 0;
+  if (!allocated
+      || (pipelinePointer->input == NULL)
+      || ((pipelinePointer->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)) {
+    freeBuffers(pipelinePointer);
+    return FALSE;}
+
+  if (!startThread(
+		   &pipelinePointer->sync,
+		   pumpPipeline,
+		   (void *) pipelinePointer)) {
+    freeBuffers(pipelinePointer);
+    close(pipelinePointer->wakeup);
+    return FALSE;}
+
+  pipelinePointer->running = TRUE;
+  return TRUE;}
+
+
+static int makeNonblocking(int descriptor) {
+  int nonblocking = TRUE;
+
+
+  return ioctl(descriptor, FIONBIO, &nonblocking) != -1;}
+
+
+static pipelineStage *newStage(
+			       pipeline *pipelinePointer,
+			       int	kind) {
+  /* Answer NULL if the pipeline has started, or has no room for another stage. */
+
+  pipelineStage *stage;
+
+
+  if (pipelinePointer->running
+      || (pipelinePointer->numberOfStages == PipelineStageLimit))
+    return NULL;
+
+  stage = &pipelinePointer->stages[pipelinePointer->numberOfStages++];
+  memset(stage, 0, sizeof(pipelineStage));
+  stage->kind = kind;
+  return stage;}
+
+
+/*
+ * primitives
+ */
+
+void newPipelineHandleInto(void) {
+  /* newPipelineHandleInto: fourByteInteger */
+
+  writeNewResourceHandle(sizeof(pipeline));}
+
+
+void registerThatPipelineHasCompletionIndex(void) {
+  /*
+   * registerThatPipeline: pipelineHandle
+   * hasCompletionIndex: semaphoreIndex
+   */
+
+  pipeline *pipelinePointer = (pipeline *) (addressForStackValue(1));
+
+
+  if (!(vm->failed())) {
+    pipelinePointer->sync.semaphore = vm->stackIntegerValue(0);
+    vm->pop(2);}}
+
+
+void addChecksumStageToPipeline(void) {
+  /* addChecksumStageTo: pipelineHandle */
+
+  /* The CRC-32 of every byte reaching this stage is in the pipeline's statistics. */
+
+  pipeline *pipelinePointer = (pipeline *) (addressForStackValue(0));
+
+
+  if (!(vm->failed())) {
+    if (newStage(pipelinePointer, checksumStage) == NULL) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(1);}}
+
+
+void addRateLimitStageToPipelineBytesPerSecond(void) {
+  /*
+   * addRateLimitStageTo: pipelineHandle
+   * bytesPerSecond: rate
+   */
+
+  pipeline	*pipelinePointer = (pipeline *) (addressForStackValue(1));
+  int		rate = vm->stackIntegerValue(0);
+  pipelineStage *stage;
+
+
+  if (!(vm->failed())) {
+    if ((rate < 1)
+	|| ((stage = newStage(pipelinePointer, rateLimitStage)) == NULL)) {
+      vm->primitiveFail();
+      return;}
+
+    stage->bytesPerSecond = rate;
+    vm->pop(2);}}
+
+
+void addFramingStageToPipelineLengthWidthBigEndian(void) {
+  /*
+   * addFramingStageTo: pipelineHandle
+   * lengthWidth: numberOfBytes
+   * bigEndian: aBoolean
+   */
+
+  /*
+   * Each piece of bytes reaching this stage becomes a frame, prefixed
+   * with its length in one, two, or four bytes. Pieces too long for
+   * the prefix become several frames.
+   */
+
+  pipeline	*pipelinePointer = (pipeline *) (addressForStackValue(2));
+  int		width = vm->stackIntegerValue(1);
+  int		bigEndian = vm->stackValue(0) == vm->trueObject();
+  pipelineStage *stage;
+
+
+  if (!(vm->failed())) {
+    if (((width != 1) && (width != 2) && (width != 4))
+	|| ((stage = newStage(pipelinePointer, framingStage)) == NULL)) {
+      vm->primitiveFail();
+      return;}
+
+    stage->lengthWidth = width;
+    stage->bigEndian = bigEndian;
+    vm->pop(3);}}
+
+
+void addCompressionStageToPipelineCodecLevelFlushEvery(void) {
+  /*
+   * addCompressionStageTo: pipelineHandle
+   * codec: codecNumber
+   * level: compressionLevel
+   * flushEvery: numberOfBytes
+   */
+
+  /*
+   * The stage flushes once the given number of bytes has reached it
+   * since its last flush, or after every piece if that's zero. Its
+   * stream is finished when the source ends.
+   */
+
+  pipeline	*pipelinePointer = (pipeline *) (addressForStackValue(3));
+  int		kind = vm->stackIntegerValue(2);
+  int		level = vm->stackIntegerValue(1);
+  int		flushEvery = vm->stackIntegerValue(0);
+  codec		*compressor;
+  pipelineStage *stage;
+
+
+  if (!(vm->failed())) {
+    if ((flushEvery < 0)
+	|| ((compressor = newCodec(kind, TRUE, level)) == NULL)) {
+      vm->primitiveFail();
+      return;}
+
+    if ((stage = newStage(pipelinePointer, compressionStage)) == NULL) {
+      freeCodec(compressor);
+      vm->primitiveFail();
+      return;}
+
+    compressor->flushEvery = flushEvery;
+    stage->codec = compressor;
+    vm->pop(4);}}
+
+
+void addDecompressionStageToPipelineCodec(void) {
+  /*
+   * addDecompressionStageTo: pipelineHandle
+   * codec: codecNumber
+   */
+
+  /* Corrupt input stops the pipeline, with an error. */
+
+  pipeline	*pipelinePointer = (pipeline *) (addressForStackValue(1));
+  int		kind = vm->stackIntegerValue(0);
+  codec		*decompressor;
+  pipelineStage *stage;
+
+
+  if (!(vm->failed())) {
+    if ((decompressor = newCodec(kind, FALSE, 0)) == NULL) {
+      vm->primitiveFail();
+      return;}
+
+    if ((stage = newStage(pipelinePointer, decompressionStage)) == NULL) {
+      freeCodec(decompressor);
+      vm->primitiveFail();
+      return;}
+
+    stage->codec = decompressor;
+    vm->pop(2);}}
+
+
+void startPipelineFromTCPSocketToTCPSocket(void) {
+  /*
+   * startPipeline: pipelineHandle
+   * from: sourceSocketHandle
+   * to: destinationSocketHandle
+   */
+
+  pipeline   *pipelinePointer = (pipeline *) (addressForStackValue(2));
+  flowSocket *source = (flowSocket *) (addressForStackValue(1));
+  flowSocket *destination = (flowSocket *) (addressForStackValue(0));
+
+
+  if (!(vm->failed())) {
+    if (pipelinePointer->running
+	|| !proxiedSocketUsable(source)
+	|| !proxiedSocketUsable(destination)
+	|| !makeNonblocking(source->resource.handle)
+	|| !makeNonblocking(destination->resource.handle)) {
+      vm->primitiveFail();
+      return;}
+
+    pipelinePointer->source = source->resource.handle;
+    pipelinePointer->destination = destination->resource.handle;
+    pipelinePointer->sourceIsFile = FALSE;
+    if (!startPipeline(pipelinePointer)) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(3);}}
+
+
+void startPipelineFromFileStartingAtToTCPSocket(void) {
+  /*
+   * startPipeline: pipelineHandle
+   * fromFile: fileHandle
+   * startingAt: fileStartIndex
+   * to: destinationSocketHandle
+   */
+
+  pipeline   *pipelinePointer = (pipeline *) (addressForStackValue(3));
+  file	     *filePointer = (file *) (addressForStackValue(2));
+  int	     start = vm->stackIntegerValue(1);
+  flowSocket *destination = (flowSocket *) (addressForStackValue(0));
+
+
+  if (!(vm->failed())) {
+    if (pipelinePointer->running
+	|| (filePointer->handle == NULL)
+	|| (start < 1)
+	|| !proxiedSocketUsable(destination)
+	|| !makeNonblocking(destination->resource.handle)) {
+      vm->primitiveFail();
+      return;}
+
+    /* Anything the stdio stream has buffered would be missed. */
+    fflush(filePointer->handle);
+    pipelinePointer->source = fileno(filePointer->handle);
+    pipelinePointer->destination = destination->resource.handle;
+    pipelinePointer->sourceIsFile = TRUE;
+    pipelinePointer->offset = start - 1;
+    if (!startPipeline(pipelinePointer)) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(4);}}
+
+
+void startPipelineFromTCPSocketToFile(void) {
+  /*
+   * startPipeline: pipelineHandle
+   * from: sourceSocketHandle
+   * toFile: fileHandle
+   */
+
+  /* Bytes are written at the file's current position. */
+
+  pipeline   *pipelinePointer = (pipeline *) (addressForStackValue(2));
+  flowSocket *source = (flowSocket *) (addressForStackValue(1));
+  file	     *filePointer = (file *) (addressForStackValue(0));
+
+
+  if (!(vm->failed())) {
+    if (pipelinePointer->running
+	|| (filePointer->handle == NULL)
+	|| !proxiedSocketUsable(source)
+	|| !makeNonblocking(source->resource.handle)) {
+      vm->primitiveFail();
+      return;}
+
+    fflush(filePointer->handle);
+    pipelinePointer->source = source->resource.handle;
+    pipelinePointer->destination = fileno(filePointer->handle);
+    pipelinePointer->sourceIsFile = FALSE;
+    if (!startPipeline(pipelinePointer)) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(3);}}
+
+
+void statisticsForPipelineInto(void) {
+  /*
+   * statisticsFor: pipelineHandle
+   * into: twentyEightByteArray
+   */
+
+  /*
+   * Write the number of bytes read and written so far as eight-byte
+   * integers, then the outcome (zero while the pipeline is still
+   * moving bytes), any error number, and the first checksum stage's
+   * checksum as four-byte integers.
+   */
+
+  pipeline	     *pipelinePointer = (pipeline *) (addressForStackValue(1));
+  int		     statistics = vm->stackObjectValue(0);
+  unsigned long long moved[2];
+  unsigned int	     outcome[3];
+  int		     index;
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(statistics) == (vm->classByteArray()))
+	|| (vm->byteSizeOf(statistics) < (sizeof(moved) + sizeof(outcome)))) {
+      vm->primitiveFail();
+      return;}
+
+    moved[0] = __atomic_load_n(&pipelinePointer->bytesIn, __ATOMIC_RELAXED);
+    moved[1] = __atomic_load_n(&pipelinePointer->bytesOut, __ATOMIC_RELAXED);
+    outcome[0] = __atomic_load_n(&pipelinePointer->result, __ATOMIC_ACQUIRE);
+    outcome[1] = __atomic_load_n(&pipelinePointer->errorNumber, __ATOMIC_RELAXED);
+    outcome[2] = 0;
+    for (index = 0; index < pipelinePointer->numberOfStages; index++)
+      if (pipelinePointer->stages[index].kind == checksumStage) {
+	outcome[2] = __atomic_load_n(&pipelinePointer->stages[index].checksum, __ATOMIC_RELAXED);
+	break;}
+
+    memcpy(
+	   (void *) (statistics + BaseHeaderSize),
+	   moved,
+	   sizeof(moved));
+    memcpy(
+	   (void *) (statistics + BaseHeaderSize + sizeof(moved)),
+	   outcome,
+	   sizeof(outcome));
+    vm->pop(2);}}
+
+
+void closePipeline(void) {
+  /* close: pipelineHandle */
+
+  /* This stops the pipeline, but leaves its source and destination open. */
+
+  pipeline *pipelinePointer = (pipeline *) (addressForStackValue(0));
+  uint64_t one = 1;
+  int	   index;
+
+
+  if (!(vm->failed())) {
+    if (pipelinePointer->running) {
+      write(pipelinePointer->wakeup, &one, sizeof(one));
+      pthread_join(pipelinePointer->sync.thread, NULL);
+      close(pipelinePointer->wakeup);
+      freeBuffers(pipelinePointer);}
+
+    for (index = 0; index < pipelinePointer->numberOfStages; index++)
+      freeCodec(pipelinePointer->stages[index].codec);
+    free((void *) pipelinePointer);
+    vm->pop(1);}}
+
+#else
+
+/* Pipelines stop through an eventfd, so they're available only on Linux. */
+
+void newPipelineHandleInto(void) {
+  vm->primitiveFail();}
+
+
+void registerThatPipelineHasCompletionIndex(void) {
+  vm->primitiveFail();}
+
+
+void addChecksumStageToPipeline(void) {
+  vm->primitiveFail();}
+
+
+void addRateLimitStageToPipelineBytesPerSecond(void) {
+  vm->primitiveFail();}
+
+
+void addFramingStageToPipelineLengthWidthBigEndian(void) {
+  vm->primitiveFail();}
+
+
+void addCompressionStageToPipelineCodecLevelFlushEvery(void) {
+  vm->primitiveFail();}
+
+
+void addDecompressionStageToPipelineCodec(void) {
+  vm->primitiveFail();}
+
+
+void startPipelineFromTCPSocketToTCPSocket(void) {
+  vm->primitiveFail();}
+
+
+void startPipelineFromFileStartingAtToTCPSocket(void) {
+  vm->primitiveFail();}
+
+
+void startPipelineFromTCPSocketToFile(void) {
+  vm->primitiveFail();}
+
+
+void statisticsForPipelineInto(void) {
+  vm->primitiveFail();}
+
+
+void closePipeline(void) {
+  vm->primitiveFail();}
+
+#endif
@@ -0,0 +1,375 @@
+/*
+ * flow: a Smalltalk streaming framework
+ * version 3
+ *
+ * proxy.c - moving bytes between resources without the VM
+ *
+ * Craig Latta
+ * netjam.org/flow
+ */
+
+/*
+ * A relay which only forwards bytes from one socket to another, or
+ * from a file to a socket, gains nothing from having each chunk
+ * cross into object memory and back out again. A proxy does the
+ * forwarding natively, in a thread of its own: between sockets with
+ * splice() through a pipe, and from files with sendfile(), so the
+ * bytes never leave the kernel. The proxy's semaphore is signalled
+ * when the source ends, or moving fails, and the image can read how
+ * many bytes have been moved at any time.
+ *
+ * A proxy moves bytes in one direction; a relay uses two. While a
+ * proxy is running, the image mustn't read from its source or write
+ * to its destination.
+ */
+
+#include "flow.h"
+extern struct VirtualMachine *vm;
+
+#ifdef LINUXISH
+
+/*
+ * utilities
+ */
+
+int waitUnlessWoken(
+		    int	  descriptor,
+		    short events,
+		    int	  wakeup,
+		    int	  milliseconds) {
+  /*
+   * Wait until the descriptor is ready, or the time has elapsed
+   * (either may be -1, for none). Answer FALSE if the wakeup eventfd
+   * was written meanwhile, as it is when a proxy or pipeline closes.
+   */
+
+  struct pollfd descriptors[2];
+  int		count;
+
+
+  descriptors[0].fd = descriptor;
+  descriptors[0].events = events;
+  descriptors[1].fd = wakeup;
+  descriptors[1].events = POLLIN;
+
+  for(;;) {
+    count = poll(
+		 descriptors,
+		 2,
+		 milliseconds);
+    if ((count >= 0) || (errno != EINTR)) break;}
+
+  return (count >= 0) && (descriptors[1].revents == 0);}
+
+
+static int pumpBetweenSockets(proxy *proxyPointer) {
+  /* Answer ready when the source ends, error if moving fails, or zero if the proxy was closed. */
+
+  ssize_t count;
+  int	  buffered = 0;
+
+
+  for(;;) {
+    if (buffered == 0) {
+      if (!waitUnlessWoken(proxyPointer->source, POLLIN, proxyPointer->wakeup, -1)) return 0;
+      count = splice(
+		     proxyPointer->source,
+		     NULL,
+		     proxyPointer->pipe[1],
+		     NULL,
+		     ProxyChunkSize,
+		     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+      if (count == 0) return ready;
+      if (count < 0) {
+	if ((errno == EAGAIN) || (errno == EINTR)) continue;
+	return error;}
+      buffered = count;}
+
+    if (!waitUnlessWoken(proxyPointer->destination, POLLOUT, proxyPointer->wakeup, -1)) return 0;
+    count = splice(
+		   proxyPointer->pipe[0],
+		   NULL,
+		   proxyPointer->destination,
+		   NULL,
+		   buffered,
+		   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (count < 0) {
+      if ((errno == EAGAIN) || (errno == EINTR)) continue;
+      return error;}
+
+    buffered -= count;
+    __atomic_add_fetch(&proxyPointer->moved, count, __ATOMIC_RELAXED);}}
+
+
+static int pumpFromFile(proxy *proxyPointer) {
+  /* Answer ready when the file or count ends, error if sending fails, or zero if the proxy was closed. */
+
+  ssize_t count;
+  size_t  chunk;
+
+
+  while (proxyPointer->remaining != 0) {
+    if (!waitUnlessWoken(proxyPointer->destination, POLLOUT, proxyPointer->wakeup, -1)) return 0;
+
+    chunk = ProxyChunkSize;
+    if ((proxyPointer->remaining > 0) && (proxyPointer->remaining < chunk))
+      chunk = proxyPointer->remaining;
+    count = sendfile(
+		     proxyPointer->destination,
+		     proxyPointer->source,
+		     &proxyPointer->offset,
+		     chunk);
+    if (count == 0) return ready;
+    if (count < 0) {
+      if ((errno == EAGAIN) || (errno == EINTR)) continue;
+      return error;}
+
+    if (proxyPointer->remaining > 0) proxyPointer->remaining -= count;
+    __atomic_add_fetch(&proxyPointer->moved, count, __ATOMIC_RELAXED);}
+
+  return ready;}
+
+
+/*
+ * thread functions
+ */
+
+/* Move bytes until the source ends, moving fails, or the proxy is closed. */
+void pumpProxy(void *parameter) {
+  proxy *proxyPointer = (proxy *) parameter;
+  int	result;
+
+
+  result = proxyPointer->sourceIsFile
+    ? pumpFromFile(proxyPointer)
+    : pumpBetweenSockets(proxyPointer);
+  if (result == 0) return;
+
+  if (result == error)
+    __atomic_store_n(&proxyPointer->errorNumber, errno, __ATOMIC_RELAXED);
+  __atomic_store_n(&proxyPointer->result, result, __ATOMIC_RELEASE);
+  synchronizedSignalSemaphoreWithIndex(proxyPointer->sync.semaphore);}
+
+
+static int startProxy(proxy *proxyPointer) {
+  /* The source and destination have been set already. */
+
+  int nonblocking = TRUE;
+
+
+  if (ioctl(proxyPointer->destination, FIONBIO, &nonblocking) == -1) return FALSE;
+  if ((proxyPointer->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0) return FALSE;
+
+  if (!proxyPointer->sourceIsFile
+      && (pipe2(proxyPointer->pipe, O_NONBLOCK | O_CLOEXEC) < 0)) {
+    close(proxyPointer->wakeup);
+    return FALSE;}
+
+  proxyPointer->moved = 0;
+  proxyPointer->result = 0;
+  proxyPointer->errorNumber = 0;
+  if (!startThread(
+		   &proxyPointer->sync,
+		   pumpProxy,
+		   (void *) proxyPointer)) {
+    if (!proxyPointer->sourceIsFile) {
+      close(proxyPointer->pipe[0]);
+      close(proxyPointer->pipe[1]);}
+    close(proxyPointer->wakeup);
+    return FALSE;}
+
+  proxyPointer->running = TRUE;
+  return TRUE;}
+
+
+int proxiedSocketUsable(flowSocket *socketPointer) {
+  /*
+   * The completion ring does its own receiving and sending, and
+   * queues hold bytes which would be sent out of order.
+   */
+
+  return (socketPointer->resource.model != completionRingModel)
+    && (socketPointer->resource.receiveQueue == NULL)
+    && (socketPointer->resource.sendQueue == NULL);}
+
+
+/*
+ * primitives
+ */
+
+void newProxyHandleInto(void) {
+  /* newProxyHandleInto: fourByteInteger */
+
+  writeNewResourceHandle(sizeof(proxy));}
+
+
+void registerThatProxyHasCompletionIndex(void) {
+  /*
+   * registerThatProxy: proxyHandle
+   * hasCompletionIndex: semaphoreIndex
+   */
+
+  proxy *proxyPointer = (proxy *) (addressForStackValue(1));
+
+
+  if (!(vm->failed())) {
+    proxyPointer->sync.semaphore = vm->stackIntegerValue(0);
+    vm->pop(2);}}
+
+
+void proxyFromTCPSocketToTCPSocket(void) {
+  /*
+   * proxy: proxyHandle
+   * from: sourceSocketHandle
+   * to: destinationSocketHandle
+   */
+
+  proxy	     *proxyPointer = (proxy *) (addressForStackValue(2));
+  flowSocket *source = (flowSocket *) (addressForStackValue(1));
+  flowSocket *destination = (flowSocket *) (addressForStackValue(0));
+
+
+  if (!(vm->failed())) {
+    if (proxyPointer->running
+	|| !proxiedSocketUsable(source)
+	|| !proxiedSocketUsable(destination)) {
+      vm->primitiveFail();
+      return;}
+
+    proxyPointer->source = source->resource.handle;
+    proxyPointer->destination = destination->resource.handle;
+    proxyPointer->sourceIsFile = FALSE;
+    if (!startProxy(proxyPointer)) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(3);}}
+
+
+void proxyFromFileStartingAtCountToTCPSocket(void) {
+  /*
+   * proxy: proxyHandle
+   * fromFile: fileHandle
+   * startingAt: fileStartIndex
+   * count: numberOfBytes
+   * to: destinationSocketHandle
+   */
+
+  /* A negative count sends the rest of the file. */
+
+  proxy	     *proxyPointer = (proxy *) (addressForStackValue(4));
+  file	     *filePointer = (file *) (addressForStackValue(3));
+  int	     start = vm->stackIntegerValue(2);
+  int	     count = vm->stackIntegerValue(1);
+  flowSocket *destination = (flowSocket *) (addressForStackValue(0));
+
+
+  if (!(vm->failed())) {
+    if (proxyPointer->running
+	|| (filePointer->handle == NULL)
+	|| (start < 1)
+	|| !proxiedSocketUsable(destination)) {
+      vm->primitiveFail();
+      return;}
+
+    /* Anything the stdio stream has buffered would be sent out of order. */
+    fflush(filePointer->handle);
+    proxyPointer->source = fileno(filePointer->handle);
+    proxyPointer->destination = destination->resource.handle;
+    proxyPointer->sourceIsFile = TRUE;
+    proxyPointer->offset = start - 1;
+    proxyPointer->remaining = (count < 0) ? -1 : count;
+    if (!startProxy(proxyPointer)) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(5);}}
+
+
+void statisticsForProxyInto(void) {
+  /*
+   * statisticsFor: proxyHandle
+   * into: sixteenByteArray
+   */
+
+  /*
+   * Write the number of bytes moved so far as an eight-byte integer,
+   * then the outcome (zero while the proxy is still moving bytes)
+   * and any error number as four-byte integers.
+   */
+
+  proxy		     *proxyPointer = (proxy *) (addressForStackValue(1));
+  int		     statistics = vm->stackObjectValue(0);
+  unsigned long long moved;
+  int		     outcome[2];
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(statistics) == (vm->classByteArray()))
+	|| (vm->byteSizeOf(statistics) < (sizeof(moved) + sizeof(outcome)))) {
+      vm->primitiveFail();
+      return;}
+
+    moved = __atomic_load_n(&proxyPointer->moved, __ATOMIC_RELAXED);
+    outcome[0] = __atomic_load_n(&proxyPointer->result, __ATOMIC_ACQUIRE);
+    outcome[1] = __atomic_load_n(&proxyPointer->errorNumber, __ATOMIC_RELAXED);
+    memcpy(
+	   (void *) (statistics + BaseHeaderSize),
+	   &moved,
+	   sizeof(moved));
+    memcpy(
+	   (void *) (statistics + BaseHeaderSize + sizeof(moved)),
+	   outcome,
+	   sizeof(outcome));
+    vm->pop(2);}}
+
+
+void closeProxy(void) {
+  /* close: proxyHandle */
+
+  /* This stops the proxy, but leaves its source and destination open. */
+
+  proxy	   *proxyPointer = (proxy *) (addressForStackValue(0));
+  uint64_t one = 1;
+
+
+  if (!(vm->failed())) {
+    if (proxyPointer->running) {
+      write(proxyPointer->wakeup, &one, sizeof(one));
+      pthread_join(proxyPointer->sync.thread, NULL);
+      close(proxyPointer->wakeup);
+      if (!proxyPointer->sourceIsFile) {
+	close(proxyPointer->pipe[0]);
+	close(proxyPointer->pipe[1]);}}
+
+    free((void *) proxyPointer);
+    vm->pop(1);}}
+
+#else
+
+/* splice() and sendfile() are Linux's; elsewhere, there are no proxies. */
+
+void newProxyHandleInto(void) {
+  vm->primitiveFail();}
+
+
+void registerThatProxyHasCompletionIndex(void) {
+  vm->primitiveFail();}
+
+
+void proxyFromTCPSocketToTCPSocket(void) {
+  vm->primitiveFail();}
+
+
+void proxyFromFileStartingAtCountToTCPSocket(void) {
+  vm->primitiveFail();}
+
+
+void statisticsForProxyInto(void) {
+  vm->primitiveFail();}
+
+
+void closeProxy(void) {
+  vm->primitiveFail();}
+
+#endif
@@ -0,0 +1,1092 @@
+/*
+ * flow: a Smalltalk streaming framework
+ * version 3
+ *
+ * queues.c - native queues of data for TCP sockets
+ *
+ * Craig Latta
+ * netjam.org/flow
+ */
+
+/*
+ * Ordinarily, a socket's reading thread signals the readability
+ * semaphore as soon as a single byte may be read, and the image
+ * then often reads just a small fragment before waiting again.
+ * With a receive queue, the reading thread instead receives
+ * eagerly, into a native ring buffer which grows as needed, and
+ * signals the semaphore only once a low-watermark amount of data
+ * is queued, or a flush timeout has elapsed since the first byte
+ * arrived. The image then takes large chunks with each primitive
+ * call.
+ *
+ * Likewise, a send queue lets the image write more than the
+ * socket's send buffer will take. What can't be sent at once is
+ * copied into a native ring, up to a high watermark, and the
+ * socket's writing thread drains it. A request to be notified of
+ * writability is answered once the queue has drained to a low
+ * watermark, rather than whenever a single byte of buffer space
+ * is free.
+ *
+ * A receive queue may also divide what it receives into frames,
+ * either length-prefixed or delimited. Readability is then
+ * signalled only once a whole frame is queued, and the image takes
+ * one whole frame at a time.
+ *
+ * Either queue may also compress or decompress the bytes passing
+ * through it (see compression.c).
+ */
+
+#include "flow.h"
+extern struct VirtualMachine *vm;
+
+#ifdef UNIXISH
+
+/*
+ * utilities
+ */
+
+static int resizeRing(
+		      char **bytes,
+		      int  *capacity,
+		      int  *start,
+		      int  count,
+		      int  newCapacity) {
+  /* Move a ring's bytes into new space, unwrapping them. */
+
+  char *resized;
+  int  first;
+
+
+  if ((resized = (char *) malloc(newCapacity)) == NULL) return FALSE;
+
+  first = *capacity - *start;
+  if (first > count) first = count;
+  memcpy(resized, *bytes + *start, first);
+  memcpy(resized + first, *bytes, count - first);
+  free(*bytes);
+  *bytes = resized;
+  *start = 0;
+  *capacity = newCapacity;
+  return TRUE;}
+
+
+static int growReceiveQueue(receiveQueue *queue) {
+  /* Double the ring. Answer FALSE if it's as big as it gets. */
+
+  if (queue->capacity >= ReceiveQueueLimit) return FALSE;
+  return resizeRing(
+		    &queue->bytes,
+		    &queue->capacity,
+		    &queue->start,
+		    queue->count,
+		    queue->capacity * 2);}
+
+
+static void ensureReceiveQueue(
+			       netResource *resource,
+			       int	   capacity) {
+  /* Give the resource an empty receive queue with at least the given capacity, if it has none. */
+
+  receiveQueue	  *queue;
+  int		  size = ReceiveQueueInitialSize;
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+  if (resource->receiveQueue != NULL) return;
+
+  while (size < capacity) size *= 2;
+  if (((queue = (receiveQueue *) calloc(1, sizeof(receiveQueue))) == NULL)
+      || ((queue->bytes = (char *) malloc(size)) == NULL)) {
+    free(queue);
+    return;}
+  queue->capacity = size;
+  queue->framing = unframed;
+  queue->mutex = mutex;
+  resource->receiveQueue = queue;}
+
+
+static char queuedByteAt(
+			 receiveQueue *queue,
+			 int	      index) {
+  return queue->bytes[(queue->start + index) % queue->capacity];}
+
+
+static void copyOutOfQueue(
+			   receiveQueue *queue,
+			   char		*target,
+			   int		count) {
+  /* The caller holds the queue mutex, and there are at least count bytes queued. */
+
+  int first;
+
+
+  first = queue->capacity - queue->start;
+  if (first > count) first = count;
+  memcpy(target, queue->bytes + queue->start, first);
+  memcpy(target + first, queue->bytes, count - first);
+  queue->start = (queue->start + count) % queue->capacity;
+  queue->count -= count;
+  queue->scanned = (queue->scanned > count) ? queue->scanned - count : 0;}
+
+
+static int completeFrameSize(receiveQueue *queue) {
+  /*
+   * Answer the size of the frame at the front of the queue, with its
+   * header or delimiter; zero if it isn't all queued yet, or -1 if it
+   * could never fit. The caller holds the queue mutex.
+   */
+
+  unsigned int length = 0, byte;
+  int	       index, position, segment;
+  char	       *found;
+
+
+  if (queue->framing == lengthPrefixed) {
+    if (queue->count < queue->headerSize) return 0;
+    for (index = 0; index < queue->lengthWidth; index++) {
+      byte = (unsigned char) queuedByteAt(queue, queue->lengthOffset + index);
+      if (queue->bigEndian)
+	length = (length << 8) | byte;
+      else
+	length |= byte << (8 * index);}
+    if (length > (unsigned int) (ReceiveQueueLimit - queue->headerSize)) return -1;
+
+    length += queue->headerSize;
+    return (queue->count >= length) ? length : 0;}
+
+  /*
+   * Look for the delimiter's first byte with memchr(), which the C
+   * library vectorizes, one contiguous stretch of the ring at a time.
+   */
+  position = queue->scanned;
+  while ((position + queue->delimiterSize) <= queue->count) {
+    index = (queue->start + position) % queue->capacity;
+    segment = queue->capacity - index;
+    if (segment > (queue->count - position)) segment = queue->count - position;
+    if ((found = (char *) memchr(queue->bytes + index, queue->delimiter[0], segment)) == NULL) {
+      position += segment;
+      continue;}
+
+    position += found - (queue->bytes + index);
+    if ((position + queue->delimiterSize) > queue->count) break;
+    for (index = 1;
+	 (index < queue->delimiterSize)
+	   && (queuedByteAt(queue, position + index) == queue->delimiter[index]);
+	 index++);
+    if (index == queue->delimiterSize) {
+      queue->scanned = position;
+      return position + queue->delimiterSize;}
+    position++;}
+
+  /* Next time, start where a delimiter might still begin. */
+  if (position > (queue->count - queue->delimiterSize + 1))
+    position = queue->count - queue->delimiterSize + 1;
+  queue->scanned = (position > 0) ? position : 0;
+
+  return (queue->count >= ReceiveQueueLimit) ? -1 : 0;}
+
+
+static void decompressIntoQueue(receiveQueue *queue) {
+  /*
+   * Decompress received bytes into the ring, growing it as needed.
+   * What doesn't fit waits for the VM to take some bytes. The caller
+   * holds the queue mutex.
+   */
+
+  codec *decompressor = queue->decompressor;
+  char	*input;
+  int	tail, room, available, produced;
+
+
+  if (decompressor->pendingCount == 0) return;
+
+  for(;;) {
+    if ((queue->count == queue->capacity) && !growReceiveQueue(queue)) return;
+    if (queue->count == 0) queue->start = 0;
+
+    tail = (queue->start + queue->count) % queue->capacity;
+    room = (tail >= queue->start) ? (queue->capacity - tail) : (queue->start - tail);
+    if (queue->count == 0) room = queue->capacity;
+
+    input = decompressor->pending + decompressor->pendingStart;
+    available = decompressor->pendingCount;
+    produced = runCodec(
+			decompressor,
+			&input,
+			&decompressor->pendingCount,
+			queue->bytes + tail,
+			room,
+			codecContinue);
+    if (produced < 0) {
+      /* The rest of the stream can never be decompressed. */
+      queue->error = EBADMSG;
+      decompressor->pendingCount = 0;
+      return;}
+
+    decompressor->pendingStart = input - decompressor->pending;
+    queue->count += produced;
+    if (((produced < room) && (decompressor->pendingCount == 0))
+	|| ((produced == 0) && (decompressor->pendingCount == available)))
+      return;}}
+
+
+static void receiveCompressedIntoQueue(
+				       receiveQueue *queue,
+				       int	    socket) {
+  /* More is received only once what was received before has been decompressed. */
+
+  codec *decompressor = queue->decompressor;
+  int	result;
+
+
+  if (decompressor->pendingCount == 0) {
+    result = recv(
+		  socket,
+		  decompressor->pending,
+		  CompressionChunkSize,
+		  MSG_DONTWAIT);
+    if (result > 0) {
+      decompressor->pendingStart = 0;
+      decompressor->pendingCount = result;}
+    else if (result == 0)
+      queue->ended = TRUE;
+    else if ((lastError() != EWOULDBLOCK) && (lastError() != EAGAIN) && (lastError() != EINTR))
+      queue->error = lastError();}
+
+  decompressIntoQueue(queue);}
+
+
+static void receiveIntoQueue(
+			     receiveQueue *queue,
+			     int	  socket) {
+  /* Receive what's available into the ring. The caller holds the queue mutex. */
+
+  int tail, room, result;
+
+
+  if (queue->decompressor != NULL) {
+    receiveCompressedIntoQueue(queue, socket);
+    return;}
+
+  if ((queue->count == queue->capacity) && !growReceiveQueue(queue)) return;
+  if (queue->count == 0) queue->start = 0;
+
+  tail = (queue->start + queue->count) % queue->capacity;
+  room = (tail >= queue->start) ? (queue->capacity - tail) : (queue->start - tail);
+  if (queue->count == 0) room = queue->capacity;
+
+  result = recv(
+		socket,
+		queue->bytes + tail,
+		room,
+		MSG_DONTWAIT);
+  if (result > 0)
+    queue->count += result;
+  else if (result == 0)
+    queue->ended = TRUE;
+  else if ((lastError() != EWOULDBLOCK) && (lastError() != EAGAIN) && (lastError() != EINTR))
+    queue->error = lastError();}
+
+
+static void sendFromQueue(
+			  sendQueue *queue,
+			  int	    socket) {
+  /*
+   * Send what the socket will take from the front of the ring. The
+   * caller holds the queue mutex. After a failure, the rest of the
+   * queue can never be sent, so drop it.
+   */
+
+  int first, result;
+
+
+  first = queue->capacity - queue->start;
+  if (first > queue->count) first = queue->count;
+
+  result = send(
+		socket,
+		queue->bytes + queue->start,
+		first,
+		MSG_DONTWAIT);
+  if (result > 0) {
+    queue->start = (queue->start + result) % queue->capacity;
+    queue->count -= result;}
+  else if ((lastError() != EWOULDBLOCK) && (lastError() != EAGAIN) && (lastError() != EINTR)) {
+    queue->error = lastError();
+    queue->count = 0;}
+
+  if (queue->count == 0) queue->start = 0;}
+
+
+static int appendToSendQueue(
+			     sendQueue *queue,
+			     char      *source,
+			     int       count) {
+  /*
+   * Copy bytes to the end of the ring, growing it if need be (only
+   * compressed output may reach past the high watermark). The caller
+   * holds the queue mutex.
+   */
+
+  int capacity = queue->capacity;
+  int tail, first;
+
+
+  while (capacity < queue->count + count) capacity *= 2;
+  if ((capacity > queue->capacity)
+      && !resizeRing(
+		     &queue->bytes,
+		     &queue->capacity,
+		     &queue->start,
+		     queue->count,
+		     capacity))
+    return FALSE;
+
+  tail = (queue->start + queue->count) % queue->capacity;
+  first = queue->capacity - tail;
+  if (first > count) first = count;
+  memcpy(queue->bytes + tail, source, first);
+  memcpy(queue->bytes, source + first, count - first);
+  queue->count += count;
+  return TRUE;}
+
+
+static int compressIntoSendQueue(
+				 sendQueue *queue,
+				 char	   *source,
+				 int	   count,
+				 int	   flush) {
+  /* Answer FALSE if the ring can't grow for the output. The caller holds the queue mutex. */
+
+  codec *compressor = queue->compressor;
+  int	available, produced;
+
+
+  do {
+    available = count;
+    produced = runCodec(
+			compressor,
+			&source,
+			&count,
+			compressor->scratch,
+			compressor->scratchSize,
+			flush);
+    if ((produced < 0) || !appendToSendQueue(queue, compressor->scratch, produced)) return FALSE;}
+  while ((produced > 0) || ((count > 0) && (count < available)));
+
+  if (flush != codecContinue) compressor->sinceFlush = 0;
+  return TRUE;}
+
+
+static int compressBytesToSend(
+			       sendQueue *queue,
+			       char	 *source,
+			       int	 count) {
+  /*
+   * Compress as many bytes as surely fit below the high watermark,
+   * flushing as the compressor's interval says. Answer how many were
+   * taken, or -1 if the ring couldn't grow. The caller holds the
+   * queue mutex.
+   */
+
+  codec *compressor = queue->compressor;
+  int	accepted = 0, chunk, flush;
+
+
+  while (accepted < count) {
+    chunk = count - accepted;
+    if (chunk > CompressionChunkSize) chunk = CompressionChunkSize;
+    while ((chunk > 0) && (codecBound(compressor, chunk) > (queue->highWatermark - queue->count)))
+      chunk /= 2;
+    if (chunk == 0) break;
+
+    compressor->sinceFlush += chunk;
+    flush = ((compressor->flushEvery > 0) && (compressor->sinceFlush >= compressor->flushEvery))
+      ? codecFlush
+      : codecContinue;
+    if (!compressIntoSendQueue(queue, source + accepted, chunk, flush)) return -1;
+    accepted += chunk;}
+
+  if ((compressor->flushEvery == 0)
+      && (accepted > 0)
+      && !compressIntoSendQueue(queue, NULL, 0, codecFlush))
+    return -1;
+
+  return accepted;}
+
+
+/*
+ * for the reading thread
+ */
+
+int fillReceiveQueue(
+		     netResource *resource,
+		     int	 timeoutInMilliseconds) {
+  /*
+   * Receive into the resource's queue until the low watermark is
+   * reached, the flush timeout elapses after the first byte, or the
+   * stream ends or fails. Answer ready, or timeout if the requested
+   * timeout elapsed with nothing queued.
+   */
+
+  receiveQueue	 *queue = (receiveQueue *) resource->receiveQueue;
+  long long	 now, deadline, flushDeadline = -1, wakeup;
+  struct timeval delay;
+  fd_set	 readingFileDescriptors;
+  int		 count, finished, framed, selectResult, cancelState;
+
+
+  now = monotonicMicroseconds() / 1000;
+  deadline = (timeoutInMilliseconds == -1) ? -1 : now + timeoutInMilliseconds;
+
+  for(;;) {
+    pthread_mutex_lock(&queue->mutex);
+    /* Room may have been made for bytes received before. */
+    if (queue->decompressor != NULL) decompressIntoQueue(queue);
+    count = queue->count;
+    framed = (queue->framing != unframed);
+    finished = (framed
+		? (completeFrameSize(queue) != 0)
+		: ((count > 0) && (count >= queue->lowWatermark)))
+      || queue->ended
+      || queue->error
+      || ((count == queue->capacity) && (queue->capacity >= ReceiveQueueLimit));
+    pthread_mutex_unlock(&queue->mutex);
+    if (finished) return ready;
+
+    /* Part of a frame is no use to the VM; only whole ones are flushed. */
+    now = monotonicMicroseconds() / 1000;
+    if (!framed && (count > 0) && (flushDeadline == -1)) flushDeadline = now + queue->flushTimeout;
+
+    /* Wake for whichever deadline comes first. */
+    wakeup = deadline;
+    if ((flushDeadline != -1) && ((wakeup == -1) || (flushDeadline < wakeup)))
+      wakeup = flushDeadline;
+    if ((wakeup != -1) && (wakeup <= now))
+      return ((count > 0) && !framed) ? ready : timeout;
+    if (wakeup != -1) {
+      delay.tv_sec = (wakeup - now) / 1000;
+      delay.tv_usec = ((wakeup - now) % 1000) * 1000;}
+
+    FD_ZERO(&readingFileDescriptors);
+    FD_SET(
+	   resource->handle,
+	   &readingFileDescriptors);
+    selectResult = select(
+			  resource->handle + 1,
+			  &readingFileDescriptors,
+			  0,
+			  0,
+			  (wakeup == -1) ? NULL : &delay);
+
+    if (selectResult > 0) {
+      /* recv() is a cancellation point; don't die holding the mutex. */
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancelState);
+      pthread_mutex_lock(&queue->mutex);
+      receiveIntoQueue(queue, resource->handle);
+      pthread_mutex_unlock(&queue->mutex);
+      pthread_setcancelstate(cancelState, NULL);}
+    else if ((selectResult == -1) && (lastError() != EINTR))
+      /* Let the next read report the trouble. */
+      return ready;}}
+
+
+/*
+ * for the writing thread
+ */
+
+int drainSendQueue(
+		   netResource *resource,
+		   int	       target,
+		   int	       timeoutInMilliseconds) {
+  /*
+   * Send from the resource's queue until no more than target bytes
+   * remain, the timeout elapses, or sending fails. Answer ready,
+   * timeout or error. A target of -1 drains the whole queue in the
+   * background, between requests; that stops early, answering
+   * timeout, once the VM has made another request.
+   */
+
+  sendQueue	 *queue = (sendQueue *) resource->sendQueue;
+  thread	 *writing = &resource->writing;
+  long long	 now, deadline;
+  struct timeval delay;
+  fd_set	 writingFileDescriptors,
+		 errorFileDescriptors;
+  int		 count, failed, selectResult, cancelState;
+  int		 background = (target == -1);
+
+
+  if (background) target = 0;
+  now = monotonicMicroseconds() / 1000;
+  deadline = (timeoutInMilliseconds == -1) ? -1 : now + timeoutInMilliseconds;
+
+  for(;;) {
+    pthread_mutex_lock(&queue->mutex);
+    count = queue->count;
+    failed = queue->error;
+    pthread_mutex_unlock(&queue->mutex);
+    if (failed) return error;
+    if (count <= target) return ready;
+    if (background
+	&& (__atomic_load_n(&writing->requestLimit, __ATOMIC_ACQUIRE) != writing->firstRequest))
+      return timeout;
+
+    now = monotonicMicroseconds() / 1000;
+    if ((deadline != -1) && (deadline <= now)) return timeout;
+    if (background) {
+      /* Look for requests now and then. */
+      delay.tv_sec = 0;
+      delay.tv_usec = SendQueueDrainInterval * 1000;}
+    else if (deadline != -1) {
+      delay.tv_sec = (deadline - now) / 1000;
+      delay.tv_usec = ((deadline - now) % 1000) * 1000;}
+
+    FD_ZERO(&writingFileDescriptors);
+    FD_ZERO(&errorFileDescriptors);
+    FD_SET(
+	   resource->handle,
+	   &writingFileDescriptors);
+    FD_SET(
+	   resource->handle,
+	   &errorFileDescriptors);
+    selectResult = select(
+			  resource->handle + 1,
+			  0,
+			  &writingFileDescriptors,
+			  &errorFileDescriptors,
+			  (background || (deadline != -1)) ? &delay : NULL);
+
+    if (selectResult > 0) {
+      /* send() is a cancellation point; don't die holding the mutex. */
+      pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, &cancelState);
+      pthread_mutex_lock(&queue->mutex);
+      sendFromQueue(queue, resource->handle);
+      pthread_mutex_unlock(&queue->mutex);
+      pthread_setcancelstate(cancelState, NULL);}
+    else if ((selectResult == -1) && (lastError() != EINTR))
+      return error;}}
+
+
+/*
+ * for the VM thread
+ */
+
+int takeQueuedBytes(
+		    netResource *resource,
+		    char	*target,
+		    int		count) {
+  /*
+   * Copy out up to count queued bytes. With none queued, receive
+   * directly, without waiting. Answer as recv() would.
+   */
+
+  receiveQueue *queue = (receiveQueue *) resource->receiveQueue;
+  int	       result;
+
+
+  pthread_mutex_lock(&queue->mutex);
+
+  /* Received bytes must be decompressed first. */
+  if ((queue->count == 0) && (queue->decompressor != NULL) && !queue->ended && !queue->error)
+    receiveIntoQueue(queue, resource->handle);
+
+  if (queue->count > 0) {
+    result = (count < queue->count) ? count : queue->count;
+    copyOutOfQueue(queue, target, result);}
+  else if (queue->ended)
+    result = 0;
+  else if (queue->error) {
+    errno = queue->error;
+    queue->error = 0;
+    result = -1;}
+  else if (queue->decompressor != NULL) {
+    errno = EWOULDBLOCK;
+    result = -1;}
+  else
+    result = recv(
+		  resource->handle,
+		  target,
+		  count,
+		  MSG_DONTWAIT);
+
+  pthread_mutex_unlock(&queue->mutex);
+  return result;}
+
+
+int queueBytesToSend(
+		     netResource *resource,
+		     char	 *source,
+		     int	 count) {
+  /*
+   * Send what can be sent at once, and queue what can't, up to the
+   * high watermark. Answer how many bytes were accepted, or -1 (with
+   * errno set) if sending has failed.
+   */
+
+  sendQueue *queue = (sendQueue *) resource->sendQueue;
+  int	    accepted = 0, taken, wasEmpty, result;
+
+
+  pthread_mutex_lock(&queue->mutex);
+
+  if (queue->error) {
+    errno = queue->error;
+    pthread_mutex_unlock(&queue->mutex);
+    return -1;}
+
+  wasEmpty = (queue->count == 0);
+  if (queue->compressor != NULL) {
+    if ((accepted = compressBytesToSend(queue, source, count)) < 0) {
+      errno = ENOBUFS;
+      pthread_mutex_unlock(&queue->mutex);
+      return -1;}
+    /* Nothing was waiting ahead of these bytes, so try sending them at once. */
+    if (wasEmpty && (queue->count > 0)) sendFromQueue(queue, resource->handle);
+    taken = queue->count;
+    pthread_mutex_unlock(&queue->mutex);}
+  else {
+    if (wasEmpty) {
+      /* Nothing is waiting ahead of these bytes, so try sending them directly. */
+      result = send(
+		    resource->handle,
+		    source,
+		    count,
+		    MSG_DONTWAIT);
+      if (result >= 0)
+	accepted = result;
+      else if ((lastError() != EWOULDBLOCK) && (lastError() != EAGAIN) && (lastError() != EINTR)) {
+	pthread_mutex_unlock(&queue->mutex);
+	return -1;}}
+
+    taken = queue->highWatermark - queue->count;
+    if (taken > count - accepted) taken = count - accepted;
+    if (taken > 0) {
+      appendToSendQueue(queue, source + accepted, taken);
+      accepted += taken;}
+    pthread_mutex_unlock(&queue->mutex);}
+
+  /*
+   * If the writing thread has run dry, start it again. If its request
+   * ring is full, it has requests to handle, and drains the queue
+   * after each of them anyway.
+   */
+  if (wasEmpty && (taken > 0))
+    postThreadRequest(
+		      &resource->writing,
+		      flowDrain,
+		      -1);
+
+  return accepted;}
+
+
+int flushSendQueueCompression(netResource *resource) {
+  /* Queue whatever the compressor is holding back. Answer FALSE if the ring couldn't grow. */
+
+  sendQueue *queue = (sendQueue *) resource->sendQueue;
+  int	    wasEmpty, flushed, count;
+
+
+  pthread_mutex_lock(&queue->mutex);
+  wasEmpty = (queue->count == 0);
+  flushed = compressIntoSendQueue(queue, NULL, 0, codecFlush);
+  if (wasEmpty && (queue->count > 0)) sendFromQueue(queue, resource->handle);
+  count = queue->count;
+  pthread_mutex_unlock(&queue->mutex);
+
+  if (wasEmpty && (count > 0))
+    postThreadRequest(
+		      &resource->writing,
+		      flowDrain,
+		      -1);
+
+  return flushed;}
+
+
+int queuedByteCount(netResource *resource) {
+  receiveQueue *queue = (receiveQueue *) resource->receiveQueue;
+  int	       count;
+
+
+  if (queue == NULL) return 0;
+  pthread_mutex_lock(&queue->mutex);
+  count = queue->count;
+  pthread_mutex_unlock(&queue->mutex);
+  return count;}
+
+
+void releaseQueues(netResource *resource) {
+  /* Anything still queued for sending is dropped. */
+
+  receiveQueue *received = (receiveQueue *) resource->receiveQueue;
+  sendQueue    *sent = (sendQueue *) resource->sendQueue;
+
+
+  if (received != NULL) {
+    resource->receiveQueue = NULL;
+    freeCodec(received->decompressor);
+    free(received->bytes);
+    free(received);}
+
+  if (sent != NULL) {
+    resource->sendQueue = NULL;
+    freeCodec(sent->compressor);
+    free(sent->bytes);
+    free(sent);}}
+
+
+/*
+ * primitives
+ */
+
+void queueReceivedDataForTCPSocketLowWatermarkFlushAfter(void) {
+  /*
+   * queueReceivedDataFor: tcpSocketHandle
+   * lowWatermark: numberOfBytes
+   * flushAfter: milliseconds
+   */
+
+  /*
+   * Have the socket's reading thread receive eagerly into a native
+   * queue, and signal readability only once the given number of
+   * bytes is queued, or the given time after the first byte
+   * arrived. A low watermark of zero goes back to signalling as
+   * soon as anything may be read (anything already queued is still
+   * read first). This also turns off any framing. Only sockets with
+   * scribing threads have a reading thread to do this.
+   */
+
+  flowSocket   *socketPointer = (flowSocket *) (addressForStackValue(2));
+  int	       lowWatermark = vm->stackIntegerValue(1);
+  int	       flushTimeout = vm->stackIntegerValue(0);
+  receiveQueue *queue;
+
+
+  if (!(vm->failed())) {
+    if ((socketPointer->resource.model != scribingThreadsModel)
+	|| (lowWatermark < 0)
+	|| (lowWatermark > ReceiveQueueLimit)
+	|| (flushTimeout < 0)) {
+      vm->primitiveFail();
+      return;}
+
+    ensureReceiveQueue(&socketPointer->resource, lowWatermark);
+    if ((queue = (receiveQueue *) socketPointer->resource.receiveQueue) == NULL) {
+      vm->primitiveFail();
+      return;}
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->framing = unframed;
+    queue->lowWatermark = lowWatermark;
+    queue->flushTimeout = flushTimeout;
+    pthread_mutex_unlock(&queue->mutex);
+    vm->pop(3);}}
+
+
+void frameReceivedDataForTCPSocketHeaderSizeLengthAtWidthBigEndian(void) {
+  /*
+   * frameReceivedDataFor: tcpSocketHandle
+   * headerSize: numberOfBytes
+   * lengthAt: headerIndex
+   * width: numberOfBytes
+   * bigEndian: aBoolean
+   */
+
+  /*
+   * Divide received data into frames, each a header of the given
+   * size, with a length field of the given width (one to four bytes)
+   * at the given index, followed by that many bytes. This enables the
+   * socket's receive queue if need be, and replaces any low watermark
+   * or other framing.
+   */
+
+  flowSocket   *socketPointer = (flowSocket *) (addressForStackValue(4));
+  int	       headerSize = vm->stackIntegerValue(3);
+  int	       lengthIndex = vm->stackIntegerValue(2);
+  int	       lengthWidth = vm->stackIntegerValue(1);
+  int	       bigEndian = (vm->stackValue(0) == vm->trueObject());
+  receiveQueue *queue;
+
+
+  if (!(vm->failed())) {
+    if ((socketPointer->resource.model != scribingThreadsModel)
+	|| (lengthWidth < 1)
+	|| (lengthWidth > 4)
+	|| (lengthIndex < 1)
+	|| ((lengthIndex - 1 + lengthWidth) > headerSize)
+	|| (headerSize > ReceiveQueueInitialSize)) {
+      vm->primitiveFail();
+      return;}
+
+    ensureReceiveQueue(&socketPointer->resource, 0);
+    if ((queue = (receiveQueue *) socketPointer->resource.receiveQueue) == NULL) {
+      vm->primitiveFail();
+      return;}
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->framing = lengthPrefixed;
+    queue->headerSize = headerSize;
+    queue->lengthOffset = lengthIndex - 1;
+    queue->lengthWidth = lengthWidth;
+    queue->bigEndian = bigEndian;
+    pthread_mutex_unlock(&queue->mutex);
+    vm->pop(5);}}
+
+
+void frameReceivedDataForTCPSocketDelimitedBy(void) {
+  /*
+   * frameReceivedDataFor: tcpSocketHandle
+   * delimitedBy: aByteArray
+   */
+
+  /*
+   * Divide received data into frames, each ending with the given
+   * delimiter (of up to FrameDelimiterLimit bytes), such as a line
+   * feed. This enables the socket's receive queue if need be, and
+   * replaces any low watermark or other framing.
+   */
+
+  flowSocket   *socketPointer = (flowSocket *) (addressForStackValue(1));
+  int	       delimiter = vm->stackObjectValue(0);
+  receiveQueue *queue;
+  int	       size;
+
+
+  if (!(vm->failed())) {
+    if ((socketPointer->resource.model != scribingThreadsModel)
+	|| !(vm->isWordsOrBytes(delimiter))
+	|| ((size = vm->byteSizeOf(delimiter)) < 1)
+	|| (size > FrameDelimiterLimit)) {
+      vm->primitiveFail();
+      return;}
+
+    ensureReceiveQueue(&socketPointer->resource, 0);
+    if ((queue = (receiveQueue *) socketPointer->resource.receiveQueue) == NULL) {
+      vm->primitiveFail();
+      return;}
+
+    pthread_mutex_lock(&queue->mutex);
+    queue->framing = delimited;
+    memcpy(
+	   queue->delimiter,
+	   (char *) (delimiter + BaseHeaderSize),
+	   size);
+    queue->delimiterSize = size;
+    queue->scanned = 0;
+    pthread_mutex_unlock(&queue->mutex);
+    vm->pop(2);}}
+
+
+void nextFrameSizeForTCPSocket(void) {
+  /* nextFrameSizeFor: tcpSocketHandle */
+
+  /*
+   * Answer the size of the next whole frame queued, including its
+   * header or delimiter, or zero if there isn't one yet. This fails
+   * if the next frame could never fit in the queue.
+   */
+
+  flowSocket   *socketPointer = (flowSocket *) (addressForStackValue(0));
+  receiveQueue *queue = (receiveQueue *) socketPointer->resource.receiveQueue;
+  int	       size;
+
+
+  if (!(vm->failed())) {
+    if ((queue == NULL) || (queue->framing == unframed)) {
+      vm->primitiveFail();
+      return;}
+
+    pthread_mutex_lock(&queue->mutex);
+    size = completeFrameSize(queue);
+    pthread_mutex_unlock(&queue->mutex);
+
+    if (size < 0) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(2);
+    vm->pushInteger(size);}}
+
+
+void nextFrameFromTCPSocketIntoStartingAt(void) {
+  /*
+   * nextFrameFrom: tcpSocketHandle
+   * into: targetByteArray
+   * startingAt: targetStartIndex
+   */
+
+  /*
+   * Take the next whole frame queued, including its header or
+   * delimiter, and answer its size, or zero if there isn't one yet.
+   * This fails, taking nothing, if the frame doesn't fit in the
+   * target from the start index; nextFrameSizeFor: tells how much
+   * room is needed.
+   */
+
+  flowSocket   *socketPointer = (flowSocket *) (addressForStackValue(2));
+  int	       target = vm->stackObjectValue(1);
+  int	       start = vm->stackIntegerValue(0);
+  receiveQueue *queue = (receiveQueue *) socketPointer->resource.receiveQueue;
+  int	       size;
+
+
+  if (!(vm->failed())) {
+    if ((queue == NULL)
+	|| (queue->framing == unframed)
+	|| !(vm->isWordsOrBytes(target))
+	|| (start < 1)) {
+      vm->primitiveFail();
+      return;}
+
+    pthread_mutex_lock(&queue->mutex);
+    size = completeFrameSize(queue);
+    if ((size < 0) || ((start - 1 + size) > vm->byteSizeOf(target))) {
+      pthread_mutex_unlock(&queue->mutex);
+      vm->primitiveFail();
+      return;}
+    if (size > 0)
+      copyOutOfQueue(
+		     queue,
+		     (char *) (target + BaseHeaderSize + start - 1),
+		     size);
+    pthread_mutex_unlock(&queue->mutex);
+
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.reading,
+		  size,
+		  size == 0);
+
+    vm->pop(4);
+    vm->pushInteger(size);}}
+
+
+void queueSentDataForTCPSocketHighWatermarkLowWatermark(void) {
+  /*
+   * queueSentDataFor: tcpSocketHandle
+   * highWatermark: numberOfBytes
+   * lowWatermark: numberOfBytes
+   */
+
+  /*
+   * From now on, writes to the socket accept whatever fits below the
+   * high watermark, sending what they can at once and queueing the
+   * rest for the socket's writing thread. Waiting for writability
+   * waits for the queue to drain to the low watermark. Enabling the
+   * queue again changes the watermarks; the queue's space only
+   * grows. Only sockets with scribing threads have a writing thread
+   * to do this.
+   */
+
+  flowSocket	  *socketPointer = (flowSocket *) (addressForStackValue(2));
+  int		  highWatermark = vm->stackIntegerValue(1);
+  int		  lowWatermark = vm->stackIntegerValue(0);
+  sendQueue	  *queue;
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  int		  resized = TRUE;
+
+
+  if (!(vm->failed())) {
+    if ((socketPointer->resource.model != scribingThreadsModel)
+	|| (highWatermark <= 0)
+	|| (highWatermark > SendQueueLimit)
+	|| (lowWatermark < 0)
+	|| (lowWatermark >= highWatermark)) {
+      vm->primitiveFail();
+      return;}
+
+    if ((queue = (sendQueue *) socketPointer->resource.sendQueue) == NULL) {
+      if (((queue = (sendQueue *) calloc(1, sizeof(sendQueue))) == NULL)
+	  || ((queue->bytes = (char *) malloc(highWatermark)) == NULL)) {
+	free(queue);
+	vm->primitiveFail();
+	return;}
+      queue->capacity = highWatermark;
+      queue->mutex = mutex;
+      socketPointer->resource.sendQueue = queue;}
+
+    pthread_mutex_lock(&queue->mutex);
+    if (highWatermark > queue->capacity)
+      resized = resizeRing(
+			   &queue->bytes,
+			   &queue->capacity,
+			   &queue->start,
+			   queue->count,
+			   highWatermark);
+    if (resized) {
+      queue->highWatermark = highWatermark;
+      queue->lowWatermark = lowWatermark;}
+    pthread_mutex_unlock(&queue->mutex);
+
+    if (!resized) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(3);}}
+
+#else
+
+/* Without pthreads, sockets have no native queues. */
+
+int fillReceiveQueue(
+		     netResource *resource,
+		     int	 timeoutInMilliseconds) {
+  return error;}
+
+
+int takeQueuedBytes(
+		    netResource *resource,
+		    char	*target,
+		    int		count) {
+  return -1;}
+
+
+int queuedByteCount(netResource *resource) {
+  return 0;}
+
+
+int drainSendQueue(
+		   netResource *resource,
+		   int	       target,
+		   int	       timeoutInMilliseconds) {
+  return error;}
+
+
+int queueBytesToSend(
+		     netResource *resource,
+		     char	 *source,
+		     int	 count) {
+  return -1;}
+
+
+void releaseQueues(netResource *resource) {}
+
+
+int flushSendQueueCompression(netResource *resource) {
+  return FALSE;}
+
+
+void queueReceivedDataForTCPSocketLowWatermarkFlushAfter(void) {
+  vm->primitiveFail();}
+
+
+void queueSentDataForTCPSocketHighWatermarkLowWatermark(void) {
+  vm->primitiveFail();}
+
+
+void frameReceivedDataForTCPSocketHeaderSizeLengthAtWidthBigEndian(void) {
+  vm->primitiveFail();}
+
+
+void frameReceivedDataForTCPSocketDelimitedBy(void) {
+  vm->primitiveFail();}
+
+
+void nextFrameSizeForTCPSocket(void) {
+  vm->primitiveFail();}
+
+
+void nextFrameFromTCPSocketIntoStartingAt(void) {
+  vm->primitiveFail();}
+
+#endif
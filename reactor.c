@@ -0,0 +1,760 @@
+/*
+ * flow: a Smalltalk streaming framework
+ * version 3
+ *
+ * reactor.c - shared epoll readiness notification for net resources
+ *
+ * Craig Latta
+ * netjam.org/flow
+ */
+
+/*
+ * In the scribing-threads model, each TCP socket has two threads,
+ * each blocked in its own select(). In the reactor model, a few
+ * threads share one epoll descriptor, which watches every
+ * registered resource. An operation requested through
+ * notifySocketWhenItMayPerformTimeoutAfter() is "armed" with the
+ * reactor; when its descriptor becomes ready, or its timeout
+ * elapses, the reactor records the result in the resource's
+ * thread structure and signals the same semaphore a scribing
+ * thread would have.
+ *
+ * Descriptors are registered with EPOLLONESHOT, so each readiness
+ * event is delivered to exactly one reactor thread, and a
+ * descriptor with nothing armed generates no events at all (not
+ * even for hangups). Events carry a slot and generation rather
+ * than a resource pointer, so that an event already fetched for a
+ * resource which was closed meanwhile is recognized and ignored.
+ *
+ * This file also has the idle loop. When it's enabled, the VM
+ * thread relinquishes the processor by waiting in epoll_wait() on
+ * an eventfd, together with the reactor's and completion ring's
+ * descriptors, rather than on the activity condition variable.
+ * I/O which becomes ready while the VM is idle is then handled by
+ * the VM thread itself, and other threads wake it by writing to
+ * the eventfd, without taking any lock.
+ */
+
+#include "flow.h"
+extern struct VirtualMachine *vm;
+
+#ifdef LINUXISH
+
+#define WakeupKey ((uint64_t) -1)
+
+static reactor  ioReactor;
+static idleLoop vmIdleLoop = {FALSE, -1, -1, -1, -1, 0, 0, FALSE};
+
+
+/*
+ * utilities
+ */
+
+long long monotonicMilliseconds(void) {
+  struct timespec now;
+
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return ((long long) now.tv_sec * 1000) + (now.tv_nsec / 1000000);}
+
+
+static uint64_t keyForResource(netResource *resource) {
+  return
+    ((uint64_t) ioReactor.generations[resource->reactorSlot] << 32)
+    | (uint64_t) resource->reactorSlot;}
+
+
+static netResource *resourceForKey(uint64_t key) {
+  int	       slot = (int) (key & 0xffffffff);
+  unsigned int generation = (unsigned int) (key >> 32);
+
+
+  if ((slot >= ioReactor.numberOfSlots)
+      || (ioReactor.generations[slot] != generation))
+    return NULL;
+  else return ioReactor.resources[slot];}
+
+
+static int takeSlot(netResource *resource) {
+  int newSize, slot;
+  void *grown;
+
+
+  if (ioReactor.numberOfFreeSlots == 0) {
+    newSize = (ioReactor.numberOfSlots == 0) ? 64 : ioReactor.numberOfSlots * 2;
+
+    if ((grown = realloc(ioReactor.resources, newSize * sizeof(netResource *))) == NULL)
+      return -1;
+    ioReactor.resources = (netResource **) grown;
+    if ((grown = realloc(ioReactor.generations, newSize * sizeof(unsigned int))) == NULL)
+      return -1;
+    ioReactor.generations = (unsigned int *) grown;
+    if ((grown = realloc(ioReactor.freeSlots, newSize * sizeof(int))) == NULL)
+      return -1;
+    ioReactor.freeSlots = (int *) grown;
+
+    /* Hand out the lowest new slots first. */
+    for (slot = newSize - 1; slot >= ioReactor.numberOfSlots; slot--) {
+      ioReactor.resources[slot] = NULL;
+      ioReactor.generations[slot] = 0;
+      ioReactor.freeSlots[ioReactor.numberOfFreeSlots++] = slot;}
+    ioReactor.numberOfSlots = newSize;}
+
+  slot = ioReactor.freeSlots[--ioReactor.numberOfFreeSlots];
+  ioReactor.resources[slot] = resource;
+  return slot;}
+
+
+static void releaseSlot(int slot) {
+  ioReactor.resources[slot] = NULL;
+  /* Invalidate any events still in flight for this slot. */
+  ioReactor.generations[slot]++;
+  ioReactor.freeSlots[ioReactor.numberOfFreeSlots++] = slot;}
+
+
+/* deadline heap */
+
+static void placeDeadline(
+			  int		  index,
+			  reactorDeadline entry) {
+  ioReactor.deadlines[index] = entry;
+  entry.operation->deadlineIndex = index;}
+
+
+static void siftDeadlineUp(int index) {
+  reactorDeadline entry = ioReactor.deadlines[index];
+  int		  parent;
+
+
+  while (index > 0) {
+    parent = (index - 1) / 2;
+    if (ioReactor.deadlines[parent].when <= entry.when) break;
+    placeDeadline(index, ioReactor.deadlines[parent]);
+    index = parent;}
+
+  placeDeadline(index, entry);}
+
+
+static void siftDeadlineDown(int index) {
+  reactorDeadline entry = ioReactor.deadlines[index];
+  int		  child;
+
+
+  for(;;) {
+    child = (index * 2) + 1;
+    if (child >= ioReactor.numberOfDeadlines) break;
+    if (((child + 1) < ioReactor.numberOfDeadlines)
+	&& (ioReactor.deadlines[child + 1].when < ioReactor.deadlines[child].when))
+      child++;
+    if (entry.when <= ioReactor.deadlines[child].when) break;
+    placeDeadline(index, ioReactor.deadlines[child]);
+    index = child;}
+
+  placeDeadline(index, entry);}
+
+
+static int addDeadline(
+		       netResource *resource,
+		       thread	   *operation) {
+  /* Answer the new entry's heap index, or -1 if there was no room. */
+
+  int		  newCapacity;
+  reactorDeadline *grown;
+
+
+  if (ioReactor.numberOfDeadlines == ioReactor.deadlineCapacity) {
+    newCapacity = (ioReactor.deadlineCapacity == 0) ? 64 : ioReactor.deadlineCapacity * 2;
+    grown = (reactorDeadline *) realloc(
+					ioReactor.deadlines,
+					newCapacity * sizeof(reactorDeadline));
+    if (grown == NULL) return -1;
+    ioReactor.deadlines = grown;
+    ioReactor.deadlineCapacity = newCapacity;}
+
+  ioReactor.deadlines[ioReactor.numberOfDeadlines].when = operation->deadline;
+  ioReactor.deadlines[ioReactor.numberOfDeadlines].operation = operation;
+  ioReactor.deadlines[ioReactor.numberOfDeadlines].resource = resource;
+  siftDeadlineUp(ioReactor.numberOfDeadlines++);
+  return operation->deadlineIndex;}
+
+
+static void removeDeadline(thread *operation) {
+  int index = operation->deadlineIndex;
+
+
+  if (index < 0) return;
+  operation->deadlineIndex = -1;
+  if (--ioReactor.numberOfDeadlines == index) return;
+
+  ioReactor.deadlines[index] = ioReactor.deadlines[ioReactor.numberOfDeadlines];
+  siftDeadlineUp(index);
+  siftDeadlineDown(ioReactor.deadlines[index].operation->deadlineIndex);}
+
+
+/* readiness */
+
+static unsigned int interestFor(netResource *resource) {
+  unsigned int events = 0;
+
+
+  if (resource->reading.armed)
+    /* A connection completes (or fails) when the socket becomes writable. */
+    events |= (resource->reading.operation == flowConnect) ? EPOLLOUT : EPOLLIN;
+  if (resource->writing.armed)
+    events |= EPOLLOUT;
+
+  return events;}
+
+
+static void updateInterest(netResource *resource) {
+  struct epoll_event event;
+  unsigned int	     interest = interestFor(resource);
+
+
+  /*
+   * With nothing armed, leave the one-shot registration disabled,
+   * so that a hung-up descriptor doesn't keep waking the reactor.
+   */
+  if (interest == 0) return;
+
+  event.events = interest | EPOLLONESHOT;
+  event.data.u64 = keyForResource(resource);
+  epoll_ctl(
+	    ioReactor.epoll,
+	    EPOLL_CTL_MOD,
+	    resource->handle,
+	    &event);}
+
+
+static void completeOperation(
+			      thread *operation,
+			      int    result) {
+  operation->armed = FALSE;
+  removeDeadline(operation);
+  operation->result = convertedInteger(result);
+  signalThreadOperation(operation);}
+
+
+static void dispatchEvent(struct epoll_event *event) {
+  netResource  *resource = resourceForKey(event->data.u64);
+  unsigned int happened = event->events;
+  unsigned int trouble = EPOLLERR | EPOLLHUP;
+
+
+  /* The resource was closed after this event was fetched. */
+  if (resource == NULL) return;
+
+  if (resource->reading.armed) {
+    if (resource->reading.operation == flowConnect) {
+      if (happened & (EPOLLOUT | trouble))
+	completeOperation(
+			  &resource->reading,
+			  connectionResult(resource->handle));}
+    else if (happened & (EPOLLIN | trouble))
+      /* As with select(), a hangup reads as readiness; recv() reports it. */
+      completeOperation(&resource->reading, ready);}
+
+  if (resource->writing.armed && (happened & (EPOLLOUT | trouble)))
+    completeOperation(&resource->writing, ready);
+
+  updateInterest(resource);}
+
+
+static int expireDeadlines(void) {
+  /*
+   * Time out every operation whose deadline has passed. Answer
+   * the number of milliseconds until the next deadline, or -1 if
+   * there is none.
+   */
+
+  long long	  now = monotonicMilliseconds();
+  reactorDeadline next;
+
+
+  while (ioReactor.numberOfDeadlines > 0) {
+    next = ioReactor.deadlines[0];
+    if (next.when > now) return (int) (next.when - now);
+    completeOperation(next.operation, timeout);
+    updateInterest(next.resource);}
+
+  return -1;}
+
+
+static void wakeReactor(void) {
+  uint64_t one = 1;
+
+
+  write(ioReactor.wakeup, &one, sizeof(one));}
+
+
+static void dispatchEvents(
+			   struct epoll_event *events,
+			   int		      count,
+			   int		      drainWakeups) {
+  /* The caller holds the reactor mutex. */
+
+  uint64_t wakeups;
+  int	   index;
+
+
+  for (index = 0; index < count; index++) {
+    if (events[index].data.u64 == WakeupKey) {
+      /*
+       * Another thread may have drained it first. Only reactor
+       * threads drain it, since only they need waking. While
+       * stopping, it's left undrained, so that every thread wakes.
+       */
+      if (drainWakeups && ioReactor.running)
+	read(ioReactor.wakeup, &wakeups, sizeof(wakeups));}
+    else dispatchEvent(&events[index]);}}
+
+
+/*
+ * thread functions
+ */
+
+/* Wait for readiness and deadlines on behalf of every registered resource. */
+void runReactor(void *parameter) {
+  struct epoll_event events[ReactorEventBatchSize];
+  int		     count, delay;
+
+
+  for(;;) {
+    pthread_mutex_lock(&ioReactor.mutex);
+    if (!ioReactor.running) {
+      pthread_mutex_unlock(&ioReactor.mutex);
+      break;}
+    delay = expireDeadlines();
+    pthread_mutex_unlock(&ioReactor.mutex);
+
+    count = epoll_wait(
+		       ioReactor.epoll,
+		       events,
+		       ReactorEventBatchSize,
+		       delay);
+    if (count <= 0) continue;
+
+    pthread_mutex_lock(&ioReactor.mutex);
+    dispatchEvents(events, count, TRUE);
+    pthread_mutex_unlock(&ioReactor.mutex);}}
+
+
+/*
+ * servicing from the VM thread
+ */
+
+int reactorDescriptor(void) {
+  return ioReactor.running ? ioReactor.epoll : -1;}
+
+
+void serviceReactor(void) {
+  /*
+   * Handle whatever is ready now, without waiting, just as a
+   * reactor thread would.
+   */
+
+  struct epoll_event events[ReactorEventBatchSize];
+  int		     count;
+
+
+  pthread_mutex_lock(&ioReactor.mutex);
+  if (ioReactor.running) {
+    count = epoll_wait(
+		       ioReactor.epoll,
+		       events,
+		       ReactorEventBatchSize,
+		       0);
+    if (count > 0) dispatchEvents(events, count, FALSE);
+    expireDeadlines();}
+  pthread_mutex_unlock(&ioReactor.mutex);}
+
+
+/*
+ * reactor lifecycle
+ */
+
+int startReactor(int numberOfThreads) {
+  pthread_mutex_t    mutex = PTHREAD_MUTEX_INITIALIZER;
+  struct epoll_event event;
+  int		     index;
+
+
+  /* There is only one reactor; starting it again reuses it. */
+  if (ioReactor.running) return TRUE;
+
+  ioReactor.mutex = mutex;
+  ioReactor.epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (ioReactor.epoll < 0) return FALSE;
+  ioReactor.wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (ioReactor.wakeup < 0) {
+    close(ioReactor.epoll);
+    return FALSE;}
+
+  event.events = EPOLLIN;
+  event.data.u64 = WakeupKey;
+  if (epoll_ctl(ioReactor.epoll, EPOLL_CTL_ADD, ioReactor.wakeup, &event) < 0) {
+    close(ioReactor.wakeup);
+    close(ioReactor.epoll);
+    return FALSE;}
+
+  ioReactor.threads = (threadSync *) calloc(numberOfThreads, sizeof(threadSync));
+  if (ioReactor.threads == NULL) {
+    close(ioReactor.wakeup);
+    close(ioReactor.epoll);
+    return FALSE;}
+
+  ioReactor.running = TRUE;
+  ioReactor.numberOfThreads = 0;
+  for (index = 0; index < numberOfThreads; index++) {
+    if (!startThread(
+		     &ioReactor.threads[index],
+		     runReactor,
+		     NULL))
+      break;
+    ioReactor.numberOfThreads++;}
+
+  if (ioReactor.numberOfThreads == 0) {
+    stopReactor();
+    return FALSE;}
+
+  return TRUE;}
+
+
+void stopReactor(void) {
+  int index;
+
+
+  if (!ioReactor.running) return;
+
+  pthread_mutex_lock(&ioReactor.mutex);
+  ioReactor.running = FALSE;
+  pthread_mutex_unlock(&ioReactor.mutex);
+
+  /* Each thread notices the shutdown after its next wakeup. */
+  wakeReactor();
+  for (index = 0; index < ioReactor.numberOfThreads; index++)
+    pthread_join(ioReactor.threads[index].thread, NULL);
+
+  free(ioReactor.threads);
+  ioReactor.threads = NULL;
+  ioReactor.numberOfThreads = 0;
+  forgetIdleLoopDescriptor(ioReactor.epoll);
+  close(ioReactor.wakeup);
+  close(ioReactor.epoll);}
+
+
+/*
+ * resource registration
+ */
+
+int registerWithReactor(netResource *resource) {
+  struct epoll_event event;
+  int		     slot, result;
+
+
+  pthread_mutex_lock(&ioReactor.mutex);
+  slot = ioReactor.running ? takeSlot(resource) : -1;
+  resource->reactorSlot = slot;
+  if (slot < 0) {
+    pthread_mutex_unlock(&ioReactor.mutex);
+    return FALSE;}
+
+  resource->model = reactorModel;
+  resource->reading.armed = FALSE;
+  resource->writing.armed = FALSE;
+  resource->reading.deadlineIndex = -1;
+  resource->writing.deadlineIndex = -1;
+
+  /* Registered disabled; arming an operation enables it. */
+  event.events = EPOLLONESHOT;
+  event.data.u64 = keyForResource(resource);
+  result = epoll_ctl(
+		     ioReactor.epoll,
+		     EPOLL_CTL_ADD,
+		     resource->handle,
+		     &event);
+  if (result < 0) {
+    /* Unregistering later mustn't release the slot again. */
+    releaseSlot(slot);
+    resource->reactorSlot = -1;}
+
+  pthread_mutex_unlock(&ioReactor.mutex);
+  return result == 0;}
+
+
+int armReactorOperation(
+			netResource *resource,
+			thread	    *operation) {
+  /*
+   * The operation and timeout have been read from the stack into
+   * the thread structure already.
+   */
+
+  int earliest = FALSE;
+
+
+  pthread_mutex_lock(&ioReactor.mutex);
+
+  /* A resource whose registration failed has nothing to arm. */
+  if (resource->reactorSlot < 0) {
+    pthread_mutex_unlock(&ioReactor.mutex);
+    return FALSE;}
+
+  /* Rearming replaces any operation still pending in this direction. */
+  removeDeadline(operation);
+  operation->armed = TRUE;
+  if (operation->timeout != -1) {
+    operation->deadline = monotonicMilliseconds() + operation->timeout;
+    switch (addDeadline(resource, operation)) {
+      case -1:
+	operation->armed = FALSE;
+	pthread_mutex_unlock(&ioReactor.mutex);
+	return FALSE;
+      case 0:
+	earliest = TRUE;
+	break;}}
+  updateInterest(resource);
+
+  pthread_mutex_unlock(&ioReactor.mutex);
+
+  /* The reactor threads may be sleeping past the new deadline. */
+  if (earliest) wakeReactor();
+  return TRUE;}
+
+
+void unregisterFromReactor(netResource *resource) {
+  pthread_mutex_lock(&ioReactor.mutex);
+
+  /* A failed registration (see registerWithReactor()) left no slot. */
+  if (resource->reactorSlot < 0) {
+    pthread_mutex_unlock(&ioReactor.mutex);
+    return;}
+
+  removeDeadline(&resource->reading);
+  removeDeadline(&resource->writing);
+  resource->reading.armed = FALSE;
+  resource->writing.armed = FALSE;
+  epoll_ctl(
+	    ioReactor.epoll,
+	    EPOLL_CTL_DEL,
+	    resource->handle,
+	    NULL);
+  releaseSlot(resource->reactorSlot);
+  resource->reactorSlot = -1;
+
+  pthread_mutex_unlock(&ioReactor.mutex);}
+
+
+
+/*
+ * idle loop
+ */
+
+enum {
+  idleWakeupKey = 1,
+  idleReactorKey,
+  idleRingKey};
+
+
+static void watchFromIdleLoop(
+			      int *watched,
+			      int descriptor,
+			      int key) {
+  /*
+   * Follow the reactor or ring descriptor, which may have been
+   * started or stopped since the VM last idled.
+   */
+
+  struct epoll_event event;
+
+
+  if (*watched == descriptor) return;
+  if (*watched >= 0)
+    epoll_ctl(vmIdleLoop.epoll, EPOLL_CTL_DEL, *watched, NULL);
+  *watched = -1;
+  if (descriptor < 0) return;
+
+  event.events = EPOLLIN;
+  event.data.u64 = key;
+  if (epoll_ctl(vmIdleLoop.epoll, EPOLL_CTL_ADD, descriptor, &event) == 0)
+    *watched = descriptor;}
+
+
+void forgetIdleLoopDescriptor(int descriptor) {
+  /*
+   * The descriptor is about to be closed, which removes it from
+   * the idle loop's epoll set.
+   */
+
+  if (vmIdleLoop.watchedReactor == descriptor) vmIdleLoop.watchedReactor = -1;
+  if (vmIdleLoop.watchedRing == descriptor) vmIdleLoop.watchedRing = -1;}
+
+
+int startIdleLoop(void) {
+  struct epoll_event event;
+
+
+  if (vmIdleLoop.enabled) return TRUE;
+  if (vmIdleLoop.epoll >= 0) {
+    /* restarting; see stopIdleLoop() */
+    __atomic_store_n(&vmIdleLoop.enabled, TRUE, __ATOMIC_SEQ_CST);
+    return TRUE;}
+
+  vmIdleLoop.epoll = epoll_create1(EPOLL_CLOEXEC);
+  if (vmIdleLoop.epoll < 0) return FALSE;
+  vmIdleLoop.wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (vmIdleLoop.wakeup < 0) {
+    close(vmIdleLoop.epoll);
+    return FALSE;}
+
+  event.events = EPOLLIN;
+  event.data.u64 = idleWakeupKey;
+  if (epoll_ctl(vmIdleLoop.epoll, EPOLL_CTL_ADD, vmIdleLoop.wakeup, &event) < 0) {
+    close(vmIdleLoop.wakeup);
+    close(vmIdleLoop.epoll);
+    return FALSE;}
+
+  vmIdleLoop.watchedReactor = -1;
+  vmIdleLoop.watchedRing = -1;
+  __atomic_store_n(&vmIdleLoop.enabled, TRUE, __ATOMIC_SEQ_CST);
+  return TRUE;}
+
+
+void stopIdleLoop(void) {
+  /*
+   * Keep the descriptors open; another thread may have just
+   * decided to write to the eventfd.
+   */
+  __atomic_store_n(&vmIdleLoop.enabled, FALSE, __ATOMIC_SEQ_CST);}
+
+
+int wakeIdleLoop(void) {
+  /*
+   * Answer FALSE if the idle loop isn't in use, so the caller can
+   * wake the VM some other way.
+   */
+
+  uint64_t one = 1;
+
+
+  if (!__atomic_load_n(&vmIdleLoop.enabled, __ATOMIC_SEQ_CST)) return FALSE;
+
+  /*
+   * Count the request before checking whether the VM is idle; the
+   * VM marks itself idle before checking the count. One of us is
+   * bound to see the other.
+   */
+  __atomic_add_fetch(&vmIdleLoop.wakeRequests, 1, __ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&vmIdleLoop.idle, __ATOMIC_SEQ_CST))
+    write(vmIdleLoop.wakeup, &one, sizeof(one));
+  return TRUE;}
+
+
+int waitInIdleLoop(int milliseconds) {
+  /*
+   * Answer FALSE if the idle loop isn't in use, so the caller can
+   * wait some other way.
+   */
+
+  struct epoll_event events[3];
+  int		     count, index;
+  uint64_t	     wakeups;
+
+
+  if (!vmIdleLoop.enabled) return FALSE;
+
+  watchFromIdleLoop(&vmIdleLoop.watchedReactor, reactorDescriptor(), idleReactorKey);
+  watchFromIdleLoop(&vmIdleLoop.watchedRing, completionRingDescriptor(), idleRingKey);
+
+  __atomic_store_n(&vmIdleLoop.idle, TRUE, __ATOMIC_SEQ_CST);
+
+  /* Don't sleep through anything signalled since the last time. */
+  if (__atomic_load_n(&vmIdleLoop.wakeRequests, __ATOMIC_SEQ_CST)
+      == vmIdleLoop.lastSeenWakeRequests) {
+    count = epoll_wait(
+		       vmIdleLoop.epoll,
+		       events,
+		       3,
+		       milliseconds);
+
+    for (index = 0; index < count; index++)
+      switch (events[index].data.u64) {
+        case idleWakeupKey:
+	  read(vmIdleLoop.wakeup, &wakeups, sizeof(wakeups));
+	  break;
+        case idleReactorKey:
+	  serviceReactor();
+	  break;
+        case idleRingKey:
+	  serviceCompletionRing();
+	  break;}}
+
+  __atomic_store_n(&vmIdleLoop.idle, FALSE, __ATOMIC_SEQ_CST);
+  vmIdleLoop.lastSeenWakeRequests =
+    __atomic_load_n(&vmIdleLoop.wakeRequests, __ATOMIC_SEQ_CST);
+  return TRUE;}
+
+#else
+
+/* There is no reactor on this platform; sockets keep their scribing threads. */
+
+long long monotonicMilliseconds(void) {
+#ifdef WIN32
+  return (long long) GetTickCount();
+#else
+  struct timeval now;
+
+
+  gettimeofday(&now, NULL);
+  return ((long long) now.tv_sec * 1000) + (now.tv_usec / 1000);
+#endif
+}
+
+
+int startReactor(int numberOfThreads) {
+  return FALSE;}
+
+
+void stopReactor(void) {}
+
+
+int registerWithReactor(netResource *resource) {
+  return FALSE;}
+
+
+int armReactorOperation(
+			netResource *resource,
+			thread	    *operation) {
+  return FALSE;}
+
+
+void unregisterFromReactor(netResource *resource) {}
+
+
+int reactorDescriptor(void) {
+  return -1;}
+
+
+void serviceReactor(void) {}
+
+
+/* Nor is there an idle loop; the VM waits on the activity condition. */
+
+int startIdleLoop(void) {
+  return FALSE;}
+
+
+void stopIdleLoop(void) {}
+
+
+int wakeIdleLoop(void) {
+  return FALSE;}
+
+
+int waitInIdleLoop(int milliseconds) {
+  return FALSE;}
+
+
+void forgetIdleLoopDescriptor(int descriptor) {}
+
+#endif
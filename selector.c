@@ -0,0 +1,294 @@
+/*
+ * flow: a Smalltalk streaming framework
+ * version 3
+ *
+ * selector.c - one semaphore for the readiness of many sockets
+ *
+ * Craig Latta
+ * netjam.org/flow
+ */
+
+/*
+ * Ordinarily, each socket signals a semaphore of its own for each
+ * direction, and a server waiting on many connections needs a
+ * process (and a semaphore) for each. A selector instead watches
+ * many sockets, and signals a single semaphore when any of them
+ * is ready. The VM then takes the whole list of ready sockets at
+ * once, as pairs of socket handles and readiness bits, and can
+ * serve every connection from one process.
+ *
+ * Each selector has an epoll descriptor and a thread which waits
+ * on it. Readiness is level-triggered: after the VM has taken
+ * every ready socket, the thread looks again, and reports any
+ * socket which is still ready.
+ */
+
+#include "flow.h"
+extern struct VirtualMachine *vm;
+
+#ifdef LINUXISH
+
+/* the epoll data of a selector's wakeup eventfd (socket handles are never zero) */
+#define SelectorWakeupKey 0
+
+
+/*
+ * utilities
+ */
+
+static unsigned int readinessBits(unsigned int events) {
+  unsigned int bits = 0;
+
+
+  if (events & EPOLLIN) bits |= SelectorReadable;
+  if (events & EPOLLOUT) bits |= SelectorWritable;
+  if (events & (EPOLLHUP | EPOLLRDHUP | EPOLLERR)) bits |= SelectorHungUp;
+
+  return bits;}
+
+
+/*
+ * thread functions
+ */
+
+/* Wait for any watched socket to be ready, then for the VM to take the list. */
+void waitForReadySockets(void *parameter) {
+  selector	     *selectorPointer = (selector *) parameter;
+  struct epoll_event events[SelectorBatchSize];
+  int		     count, index, numberOfReady;
+
+
+  for(;;) {
+    count = epoll_wait(
+		       selectorPointer->handle,
+		       events,
+		       SelectorBatchSize,
+		       -1);
+    if (__atomic_load_n(&selectorPointer->closing, __ATOMIC_ACQUIRE)) break;
+    if (count <= 0) continue;
+
+    numberOfReady = 0;
+    for (index = 0; index < count; index++)
+      if (events[index].data.u64 != SelectorWakeupKey)
+	selectorPointer->ready[numberOfReady++] = events[index];
+    if (numberOfReady == 0) continue;
+
+    __atomic_store_n(&selectorPointer->numberOfReady, numberOfReady, __ATOMIC_RELEASE);
+    synchronizedSignalSemaphoreWithIndex(selectorPointer->sync.semaphore);
+
+    /* The VM signals this thread when it has taken the last one. */
+    while (__atomic_load_n(&selectorPointer->numberOfReady, __ATOMIC_ACQUIRE) > 0) {
+      waitForThreadSignal(&selectorPointer->sync);
+      if (__atomic_load_n(&selectorPointer->closing, __ATOMIC_ACQUIRE)) return;}}}
+
+
+/*
+ * primitives
+ */
+
+void newSelectorHandleInto(void) {
+  /* newSelectorHandleInto: fourByteInteger */
+
+  writeNewResourceHandle(sizeof(selector));}
+
+
+void registerThatSelectorHasReadinessIndex(void) {
+  /*
+   * registerThatSelector: selectorHandle
+   * hasReadinessIndex: readinessIndex
+   */
+
+  selector *selectorPointer = (selector *) (addressForStackValue(1));
+
+
+  if (!(vm->failed())) {
+    selectorPointer->sync.semaphore = vm->stackIntegerValue(0);
+    vm->pop(2);}}
+
+
+void enableSelector(void) {
+  /* enableSelector: selectorHandle */
+
+  selector	     *selectorPointer = (selector *) (addressForStackValue(0));
+  struct epoll_event event;
+
+
+  if (!(vm->failed())) {
+    selectorPointer->handle = epoll_create1(EPOLL_CLOEXEC);
+    if (selectorPointer->handle < 0) {
+      vm->primitiveFail();
+      return;}
+
+    selectorPointer->wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    event.events = EPOLLIN;
+    event.data.u64 = SelectorWakeupKey;
+    if ((selectorPointer->wakeup < 0)
+	|| (epoll_ctl(
+		      selectorPointer->handle,
+		      EPOLL_CTL_ADD,
+		      selectorPointer->wakeup,
+		      &event)
+	    < 0)
+	|| !startThread(
+			&selectorPointer->sync,
+			waitForReadySockets,
+			(void *) selectorPointer)) {
+      if (selectorPointer->wakeup >= 0) close(selectorPointer->wakeup);
+      close(selectorPointer->handle);
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(1);}}
+
+
+void watchSocketWithSelectorFor(void) {
+  /*
+   * watch: socketHandle
+   * with: selectorHandle
+   * for: interestBits
+   */
+
+  /*
+   * Watch the socket for the given readiness (SelectorReadable
+   * and SelectorWritable bits), replacing any earlier interest.
+   * No bits stops watching it. Closing a socket stops watching it
+   * too. Sockets using the completion ring can't be watched, since
+   * their data is received for them.
+   */
+
+  int		     socketAddress = addressForStackValue(2);
+  flowSocket	     *socketPointer = (flowSocket *) socketAddress;
+  selector	     *selectorPointer = (selector *) (addressForStackValue(1));
+  int		     interest = vm->stackIntegerValue(0);
+  struct epoll_event event;
+  int		     result;
+
+
+  if (!(vm->failed())) {
+    if (socketPointer->resource.model == completionRingModel) {
+      vm->primitiveFail();
+      return;}
+
+    if (interest == 0)
+      result = epoll_ctl(
+			 selectorPointer->handle,
+			 EPOLL_CTL_DEL,
+			 socketPointer->resource.handle,
+			 NULL);
+    else {
+      event.events = EPOLLRDHUP;
+      if (interest & SelectorReadable) event.events |= EPOLLIN;
+      if (interest & SelectorWritable) event.events |= EPOLLOUT;
+      /* Report the handle the image knows the socket by. */
+      event.data.u64 = (unsigned int) socketAddress;
+      result = epoll_ctl(
+			 selectorPointer->handle,
+			 EPOLL_CTL_MOD,
+			 socketPointer->resource.handle,
+			 &event);
+      if ((result < 0) && (errno == ENOENT))
+	result = epoll_ctl(
+			   selectorPointer->handle,
+			   EPOLL_CTL_ADD,
+			   socketPointer->resource.handle,
+			   &event);}
+
+    if (result < 0) {
+      vm->primitiveFail();
+      return;}
+
+    vm->pop(3);}}
+
+
+void readySocketsFromSelectorInto(void) {
+  /*
+   * readyFrom: selectorHandle
+   * into: aByteArray
+   */
+
+  /*
+   * Copy as many ready sockets as fit into the ByteArray, eight
+   * bytes each: the socket's four-byte handle, then its readiness
+   * bits. Answer how many were copied. Any left over are answered
+   * next time, before the selector looks for more.
+   */
+
+  selector     *selectorPointer = (selector *) (addressForStackValue(1));
+  int	       list = vm->stackObjectValue(0);
+  int	       numberOfReady, count, room, index;
+  unsigned int entry[2];
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(list) == (vm->classByteArray()))) {
+      vm->primitiveFail();
+      return;}
+
+    numberOfReady = __atomic_load_n(&selectorPointer->numberOfReady, __ATOMIC_ACQUIRE);
+    count = numberOfReady - selectorPointer->firstReady;
+    room = vm->byteSizeOf(list) / sizeof(entry);
+    if (count > room) count = room;
+
+    for (index = 0; index < count; index++) {
+      entry[0] = (unsigned int) selectorPointer->ready[selectorPointer->firstReady + index].data.u64;
+      entry[1] = readinessBits(selectorPointer->ready[selectorPointer->firstReady + index].events);
+      memcpy(
+	     (void *) (list + BaseHeaderSize + (index * sizeof(entry))),
+	     entry,
+	     sizeof(entry));}
+
+    selectorPointer->firstReady += count;
+    if ((numberOfReady > 0) && (selectorPointer->firstReady == numberOfReady)) {
+      /* All taken; let the selector thread look again. */
+      selectorPointer->firstReady = 0;
+      __atomic_store_n(&selectorPointer->numberOfReady, 0, __ATOMIC_RELEASE);
+      signalThread(&selectorPointer->sync);}
+
+    vm->pop(3);
+    vm->pushInteger(count);}}
+
+
+void closeSelector(void) {
+  /* close: selectorHandle */
+
+  selector *selectorPointer = (selector *) (addressForStackValue(0));
+  uint64_t one = 1;
+
+
+  if (!(vm->failed())) {
+    __atomic_store_n(&selectorPointer->closing, TRUE, __ATOMIC_RELEASE);
+    write(selectorPointer->wakeup, &one, sizeof(one));
+    stopThread(&selectorPointer->sync);
+    close(selectorPointer->wakeup);
+    close(selectorPointer->handle);
+    free((void *) selectorPointer);
+    vm->pop(1);}}
+
+#else
+
+/* Selectors use epoll, so they're available only on Linux. */
+
+void newSelectorHandleInto(void) {
+  vm->primitiveFail();}
+
+
+void registerThatSelectorHasReadinessIndex(void) {
+  vm->primitiveFail();}
+
+
+void enableSelector(void) {
+  vm->primitiveFail();}
+
+
+void watchSocketWithSelectorFor(void) {
+  vm->primitiveFail();}
+
+
+void readySocketsFromSelectorInto(void) {
+  vm->primitiveFail();}
+
+
+void closeSelector(void) {
+  vm->primitiveFail();}
+
+#endif
@@ -0,0 +1,751 @@
+/*
+ * flow: a Smalltalk streaming framework
+ * version 3
+ *
+ * uring.c - io_uring completion ring for TCP sockets
+ *
+ * Craig Latta
+ * netjam.org/flow
+ */
+
+/*
+ * In the completion ring model, a TCP socket neither waits for
+ * readiness and then calls recv() or send() from the VM thread,
+ * nor has threads of its own. Instead, a read notification queues
+ * the receive itself with a shared io_uring, into a native buffer
+ * (object memory may move before the receive completes), linked
+ * to a timeout. A send copies its bytes out and queues them. One
+ * reaper thread collects completions in batches, records results
+ * in the resource's thread structures, and signals the same
+ * semaphores a scribing thread would have. The data primitives
+ * then just copy bytes in or out.
+ *
+ * Each socket's ring state lives in a ringChannel, which outlives
+ * the socket until every operation it queued has completed, since
+ * the kernel may still be writing into its buffers.
+ */
+
+#include "flow.h"
+extern struct VirtualMachine *vm;
+
+#if ((defined LINUXISH) && (defined __NR_io_uring_setup))
+
+/* what each submission was for, in the low bits of its user data */
+enum {
+  ringWakeup = 0,
+  ringReceive,
+  ringReceiveTimeout,
+  ringPoll,
+  ringPollTimeout,
+  ringSend,
+  ringWriteTimeout,
+  ringCancel};
+
+#define RingKindMask	7
+
+static completionRing ioRing;
+
+
+/*
+ * utilities
+ */
+
+static int ringSetup(
+		     unsigned int	    entries,
+		     struct io_uring_params *parameters) {
+  return (int) syscall(__NR_io_uring_setup, entries, parameters);}
+
+
+static int ringEnter(
+		     unsigned int toSubmit,
+		     unsigned int minimumCompletions,
+		     unsigned int flags) {
+  return (int) syscall(
+		       __NR_io_uring_enter,
+		       ioRing.descriptor,
+		       toSubmit,
+		       minimumCompletions,
+		       flags,
+		       NULL,
+		       0);}
+
+
+static void unmapRing(void) {
+  if (ioRing.submissions != NULL)
+    munmap(ioRing.submissions, ioRing.entriesSize);
+  if ((ioRing.completionRing != NULL) && (ioRing.completionRing != ioRing.submissionRing))
+    munmap(ioRing.completionRing, ioRing.completionRingSize);
+  if (ioRing.submissionRing != NULL)
+    munmap(ioRing.submissionRing, ioRing.submissionRingSize);
+  ioRing.submissions = NULL;
+  ioRing.completionRing = NULL;
+  ioRing.submissionRing = NULL;}
+
+
+static int mapRing(struct io_uring_params *parameters) {
+  void *mapped;
+  char *submissionRing, *completionRing;
+
+
+  ioRing.submissionRingSize =
+    parameters->sq_off.array + (parameters->sq_entries * sizeof(unsigned int));
+  ioRing.completionRingSize =
+    parameters->cq_off.cqes + (parameters->cq_entries * sizeof(struct io_uring_cqe));
+  if (parameters->features & IORING_FEAT_SINGLE_MMAP) {
+    if (ioRing.completionRingSize > ioRing.submissionRingSize)
+      ioRing.submissionRingSize = ioRing.completionRingSize;
+    ioRing.completionRingSize = ioRing.submissionRingSize;}
+
+  mapped = mmap(
+		NULL,
+		ioRing.submissionRingSize,
+		PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE,
+		ioRing.descriptor,
+		IORING_OFF_SQ_RING);
+  if (mapped == MAP_FAILED) return FALSE;
+  ioRing.submissionRing = mapped;
+
+  if (parameters->features & IORING_FEAT_SINGLE_MMAP)
+    ioRing.completionRing = ioRing.submissionRing;
+  else {
+    mapped = mmap(
+		  NULL,
+		  ioRing.completionRingSize,
+		  PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE,
+		  ioRing.descriptor,
+		  IORING_OFF_CQ_RING);
+    if (mapped == MAP_FAILED) {
+      unmapRing();
+      return FALSE;}
+    ioRing.completionRing = mapped;}
+
+  ioRing.entriesSize = parameters->sq_entries * sizeof(struct io_uring_sqe);
+  mapped = mmap(
+		NULL,
+		ioRing.entriesSize,
+		PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE,
+		ioRing.descriptor,
+		IORING_OFF_SQES);
+  if (mapped == MAP_FAILED) {
+    unmapRing();
+    return FALSE;}
+  ioRing.submissions = (struct io_uring_sqe *) mapped;
+
+  submissionRing = (char *) ioRing.submissionRing;
+  ioRing.submissionHead = (unsigned int *) (submissionRing + parameters->sq_off.head);
+  ioRing.submissionTailPointer = (unsigned int *) (submissionRing + parameters->sq_off.tail);
+  ioRing.submissionMask = (unsigned int *) (submissionRing + parameters->sq_off.ring_mask);
+  ioRing.submissionArray = (unsigned int *) (submissionRing + parameters->sq_off.array);
+
+  completionRing = (char *) ioRing.completionRing;
+  ioRing.completionHead = (unsigned int *) (completionRing + parameters->cq_off.head);
+  ioRing.completionTail = (unsigned int *) (completionRing + parameters->cq_off.tail);
+  ioRing.completionMask = (unsigned int *) (completionRing + parameters->cq_off.ring_mask);
+  ioRing.completions = (struct io_uring_cqe *) (completionRing + parameters->cq_off.cqes);
+
+  ioRing.entries = parameters->sq_entries;
+  ioRing.submissionTail = *ioRing.submissionTailPointer;
+  return TRUE;}
+
+
+static void setTimeout(
+		       struct __kernel_timespec *timeSpec,
+		       int			milliseconds) {
+  timeSpec->tv_sec = milliseconds / 1000;
+  timeSpec->tv_nsec = (milliseconds % 1000) * 1000000;}
+
+
+/* submissions; the caller holds the ring mutex */
+
+static void flushSubmissions(void) {
+  unsigned int unconsumed;
+
+
+  __atomic_store_n(
+		   ioRing.submissionTailPointer,
+		   ioRing.submissionTail,
+		   __ATOMIC_RELEASE);
+  unconsumed =
+    ioRing.submissionTail - __atomic_load_n(ioRing.submissionHead, __ATOMIC_ACQUIRE);
+  if (unconsumed > 0)
+    while ((ringEnter(unconsumed, 0, 0) < 0) && (errno == EINTR));}
+
+
+static int reserveSubmissions(unsigned int count) {
+  /* Make room for count consecutive submissions, if possible. */
+
+  if ((ioRing.submissionTail
+       - __atomic_load_n(ioRing.submissionHead, __ATOMIC_ACQUIRE))
+      + count <= ioRing.entries)
+    return TRUE;
+
+  flushSubmissions();
+  return
+    (ioRing.submissionTail
+     - __atomic_load_n(ioRing.submissionHead, __ATOMIC_ACQUIRE))
+    + count <= ioRing.entries;}
+
+
+static struct io_uring_sqe *nextSubmission(
+					   ringChannel *channel,
+					   int	       kind) {
+  /* Room must have been reserved already. */
+
+  unsigned int	      index = ioRing.submissionTail & *ioRing.submissionMask;
+  struct io_uring_sqe *submission = &ioRing.submissions[index];
+
+
+  memset(submission, 0, sizeof(*submission));
+  submission->user_data = ((uint64_t) (uintptr_t) channel) | kind;
+  ioRing.submissionArray[index] = index;
+  ioRing.submissionTail++;
+  if (channel != NULL) channel->inFlight++;
+  return submission;}
+
+
+static void linkTimeout(
+			ringChannel		 *channel,
+			int			 kind,
+			struct __kernel_timespec *timeSpec,
+			int			 milliseconds) {
+  struct io_uring_sqe *submission;
+
+
+  setTimeout(timeSpec, milliseconds);
+  submission = nextSubmission(channel, kind);
+  submission->opcode = IORING_OP_LINK_TIMEOUT;
+  submission->fd = -1;
+  submission->addr = (uint64_t) (uintptr_t) timeSpec;
+  submission->len = 1;}
+
+
+static int submitReceive(
+			 ringChannel *channel,
+			 int	     milliseconds) {
+  struct io_uring_sqe *submission;
+  int		      timed = milliseconds != -1;
+
+
+  if (!reserveSubmissions(timed ? 2 : 1)) return FALSE;
+
+  submission = nextSubmission(channel, ringReceive);
+  submission->opcode = IORING_OP_RECV;
+  submission->fd = channel->handle;
+  submission->addr = (uint64_t) (uintptr_t) channel->receiveBuffer;
+  submission->len = RingReceiveBufferSize;
+  if (timed) {
+    /* When the timeout wins, the receive completes with ECANCELED. */
+    submission->flags = IOSQE_IO_LINK;
+    linkTimeout(channel, ringReceiveTimeout, &channel->receiveTimeout, milliseconds);}
+
+  channel->receiving = TRUE;
+  channel->receiveStart = 0;
+  channel->receiveStop = 0;
+  flushSubmissions();
+  return TRUE;}
+
+
+static int submitPoll(
+		      ringChannel *channel,
+		      int	  events,
+		      int	  milliseconds) {
+  /* Connecting and accepting just wait for readiness, as with the reactor. */
+
+  struct io_uring_sqe *submission;
+  int		      timed = milliseconds != -1;
+
+
+  if (!reserveSubmissions(timed ? 2 : 1)) return FALSE;
+
+  submission = nextSubmission(channel, ringPoll);
+  submission->opcode = IORING_OP_POLL_ADD;
+  submission->fd = channel->handle;
+  submission->poll32_events = events;
+  if (timed) {
+    submission->flags = IOSQE_IO_LINK;
+    linkTimeout(channel, ringPollTimeout, &channel->receiveTimeout, milliseconds);}
+
+  flushSubmissions();
+  return TRUE;}
+
+
+static int submitSend(ringChannel *channel) {
+  struct io_uring_sqe *submission;
+
+
+  if (!reserveSubmissions(1)) return FALSE;
+
+  submission = nextSubmission(channel, ringSend);
+  submission->opcode = IORING_OP_SEND;
+  submission->fd = channel->handle;
+  submission->addr = (uint64_t) (uintptr_t) (channel->sendBuffer + channel->sendStart);
+  submission->len = channel->sendStop - channel->sendStart;
+  submission->msg_flags = MSG_NOSIGNAL;
+
+  flushSubmissions();
+  return TRUE;}
+
+
+static int submitWriteTimeout(
+			      ringChannel *channel,
+			      int	  milliseconds) {
+  /*
+   * A plain timeout; when it expires, it only counts if the write
+   * wait it was for is still the current one.
+   */
+
+  struct io_uring_sqe *submission;
+
+
+  if (!reserveSubmissions(1)) return FALSE;
+
+  setTimeout(&channel->writeTimeout, milliseconds);
+  channel->writeDeadline = monotonicMilliseconds() + milliseconds;
+  submission = nextSubmission(channel, ringWriteTimeout);
+  submission->opcode = IORING_OP_TIMEOUT;
+  submission->fd = -1;
+  submission->addr = (uint64_t) (uintptr_t) &channel->writeTimeout;
+  submission->len = 1;
+
+  flushSubmissions();
+  return TRUE;}
+
+
+static void submitCancel(
+			 ringChannel *channel,
+			 int	     kind) {
+  struct io_uring_sqe *submission;
+
+
+  if (!reserveSubmissions(1)) return;
+
+  submission = nextSubmission(channel, ringCancel);
+  submission->opcode = IORING_OP_ASYNC_CANCEL;
+  submission->fd = -1;
+  submission->addr = ((uint64_t) (uintptr_t) channel) | kind;}
+
+
+/* completions; the caller holds the ring mutex */
+
+static void freeChannel(ringChannel *channel) {
+  free(channel->receiveBuffer);
+  free(channel->sendBuffer);
+  free(channel);}
+
+
+static void finishOperation(
+			    ringChannel *channel,
+			    thread	*operation,
+			    int		result) {
+  /* Nobody is waiting once the resource has closed. */
+  if (channel->resource == NULL) return;
+
+  operation->result = convertedInteger(result);
+  signalThreadOperation(operation);}
+
+
+static void processCompletion(struct io_uring_cqe *completion) {
+  ringChannel *channel =
+    (ringChannel *) (uintptr_t) (completion->user_data & ~((uint64_t) RingKindMask));
+  netResource *resource;
+  int	      kind = (int) (completion->user_data & RingKindMask);
+  int	      result = completion->res;
+
+
+  /* a wakeup from stopCompletionRing() */
+  if (channel == NULL) return;
+
+  channel->inFlight--;
+  resource = channel->resource;
+
+  switch (kind) {
+    case ringReceive:
+      channel->receiving = FALSE;
+      if (result > 0)
+	channel->receiveStop = result;
+      else if (result == 0)
+	channel->receiveEnded = TRUE;
+      else if (result != -ECANCELED)
+	channel->receiveError = -result;
+
+      if (resource != NULL)
+	finishOperation(
+			channel,
+			&resource->reading,
+			(result == -ECANCELED) ? timeout : ready);
+      break;
+
+    case ringPoll:
+      if (resource == NULL) break;
+      if (result == -ECANCELED)
+	finishOperation(channel, &resource->reading, timeout);
+      else if (result < 0)
+	finishOperation(channel, &resource->reading, error);
+      else if (resource->reading.operation == flowConnect)
+	finishOperation(
+			channel,
+			&resource->reading,
+			connectionResult(channel->handle));
+      else finishOperation(channel, &resource->reading, ready);
+      break;
+
+    case ringSend:
+      if (result < 0) {
+	channel->sendError = -result;
+	channel->sending = FALSE;}
+      else {
+	channel->sendStart += result;
+	if (channel->sendStart < channel->sendStop)
+	  /* a short send; queue the rest */
+	  channel->sending = submitSend(channel);
+	else channel->sending = FALSE;}
+
+      if ((!channel->sending) && (resource != NULL) && resource->writing.armed) {
+	resource->writing.armed = FALSE;
+	finishOperation(channel, &resource->writing, ready);}
+      break;
+
+    case ringWriteTimeout:
+      if ((result == -ETIME)
+	  && (resource != NULL)
+	  && resource->writing.armed
+	  && (channel->writeDeadline <= monotonicMilliseconds())) {
+	resource->writing.armed = FALSE;
+	finishOperation(channel, &resource->writing, timeout);}
+      break;
+
+    default:
+      /* Linked timeouts and cancellations need no attention. */
+      break;}
+
+  if ((channel->resource == NULL) && (channel->inFlight == 0))
+    freeChannel(channel);}
+
+
+static void processCompletions(void) {
+  /* The caller holds the ring mutex. */
+
+  unsigned int head = *ioRing.completionHead;
+  unsigned int tail = __atomic_load_n(ioRing.completionTail, __ATOMIC_ACQUIRE);
+
+
+  while (head != tail) {
+    processCompletion(&ioRing.completions[head & *ioRing.completionMask]);
+    head++;}
+  __atomic_store_n(ioRing.completionHead, head, __ATOMIC_RELEASE);}
+
+
+/*
+ * thread functions
+ */
+
+/* Collect completions in batches, for every attached resource. */
+void reapCompletions(void *parameter) {
+  int running;
+
+
+  for(;;) {
+    ringEnter(0, 1, IORING_ENTER_GETEVENTS);
+
+    pthread_mutex_lock(&ioRing.mutex);
+    processCompletions();
+    running = ioRing.running;
+    pthread_mutex_unlock(&ioRing.mutex);
+
+    if (!running) break;}}
+
+
+/*
+ * servicing from the VM thread
+ */
+
+int completionRingDescriptor(void) {
+  return ioRing.running ? ioRing.descriptor : -1;}
+
+
+void serviceCompletionRing(void) {
+  /* Collect whatever has completed, just as the reaper would. */
+
+  pthread_mutex_lock(&ioRing.mutex);
+  if (ioRing.running) processCompletions();
+  pthread_mutex_unlock(&ioRing.mutex);}
+
+
+/*
+ * ring lifecycle
+ */
+
+int startCompletionRing(int entries) {
+  pthread_mutex_t	 mutex = PTHREAD_MUTEX_INITIALIZER;
+  struct io_uring_params parameters;
+
+
+  /* There is only one ring; starting it again reuses it. */
+  if (ioRing.running) return TRUE;
+
+  memset(&parameters, 0, sizeof(parameters));
+  ioRing.descriptor = ringSetup(entries, &parameters);
+  if (ioRing.descriptor < 0) return FALSE;
+  if (!mapRing(&parameters)) {
+    close(ioRing.descriptor);
+    return FALSE;}
+
+  ioRing.mutex = mutex;
+  ioRing.running = TRUE;
+  if (!startThread(
+		   &ioRing.reaper,
+		   reapCompletions,
+		   NULL)) {
+    ioRing.running = FALSE;
+    unmapRing();
+    close(ioRing.descriptor);
+    return FALSE;}
+
+  return TRUE;}
+
+
+void stopCompletionRing(void) {
+  if (!ioRing.running) return;
+
+  pthread_mutex_lock(&ioRing.mutex);
+  ioRing.running = FALSE;
+  /* A no-op completion wakes the reaper, which then notices. */
+  if (reserveSubmissions(1))
+    nextSubmission(NULL, ringWakeup)->opcode = IORING_OP_NOP;
+  flushSubmissions();
+  pthread_mutex_unlock(&ioRing.mutex);
+
+  pthread_join(ioRing.reaper.thread, NULL);
+  unmapRing();
+  forgetIdleLoopDescriptor(ioRing.descriptor);
+  close(ioRing.descriptor);}
+
+
+/*
+ * resource attachment
+ */
+
+int attachToCompletionRing(netResource *resource) {
+  ringChannel *channel;
+
+
+  if (!ioRing.running) return FALSE;
+
+  channel = (ringChannel *) calloc(1, sizeof(ringChannel));
+  if (channel == NULL) return FALSE;
+  channel->receiveBuffer = (char *) malloc(RingReceiveBufferSize);
+  if (channel->receiveBuffer == NULL) {
+    free(channel);
+    return FALSE;}
+
+  channel->resource = resource;
+  channel->handle = resource->handle;
+  resource->channel = channel;
+  resource->model = completionRingModel;
+  return TRUE;}
+
+
+int armRingOperation(
+		     netResource *resource,
+		     thread	 *operation) {
+  /*
+   * The operation and timeout have been read from the stack into
+   * the thread structure already.
+   */
+
+  ringChannel *channel = (ringChannel *) resource->channel;
+  int	      armed = TRUE;
+
+
+  pthread_mutex_lock(&ioRing.mutex);
+
+  if (operation == &resource->reading) {
+    switch (operation->operation) {
+      case flowRead:
+	if (channel->receiving)
+	  /* The receive already queued will signal. */
+	  break;
+	if ((channel->receiveStop > channel->receiveStart)
+	    || channel->receiveEnded
+	    || channel->receiveError)
+	  /* There is something to report already. */
+	  finishOperation(channel, operation, ready);
+	else armed = submitReceive(channel, operation->timeout);
+	break;
+
+      case flowConnect:
+	armed = submitPoll(channel, POLLOUT, operation->timeout);
+	break;
+
+      default:
+	armed = submitPoll(channel, POLLIN, operation->timeout);
+	break;}}
+
+  else {
+    if (!channel->sending)
+      finishOperation(channel, operation, ready);
+    else {
+      operation->armed = TRUE;
+      if (operation->timeout != -1)
+	armed = submitWriteTimeout(channel, operation->timeout);}}
+
+  pthread_mutex_unlock(&ioRing.mutex);
+  return armed;}
+
+
+int takeReceivedBytes(
+		      netResource *resource,
+		      char	  *target,
+		      int	  count) {
+  /*
+   * Copy out up to count bytes already received. Answer how many
+   * were copied, zero at end of stream, or -1 if there are none
+   * yet (with errno EWOULDBLOCK) or the receive failed.
+   */
+
+  ringChannel *channel = (ringChannel *) resource->channel;
+  int	      available, result;
+
+
+  pthread_mutex_lock(&ioRing.mutex);
+
+  available = channel->receiveStop - channel->receiveStart;
+  if (available > 0) {
+    result = (count < available) ? count : available;
+    memcpy(
+	   target,
+	   channel->receiveBuffer + channel->receiveStart,
+	   result);
+    channel->receiveStart += result;}
+  else if (channel->receiveEnded)
+    result = 0;
+  else {
+    if (channel->receiveError) {
+      errno = channel->receiveError;
+      channel->receiveError = 0;}
+    else errno = EWOULDBLOCK;
+    result = -1;}
+
+  pthread_mutex_unlock(&ioRing.mutex);
+  return result;}
+
+
+int queueSend(
+	      netResource *resource,
+	      char	  *source,
+	      int	  count) {
+  /*
+   * Copy count bytes out of object memory and queue them. Answer
+   * count, or -1 if a previous send is still in flight (with errno
+   * EWOULDBLOCK) or failed.
+   */
+
+  ringChannel *channel = (ringChannel *) resource->channel;
+  char	      *grown;
+  int	      result = count;
+
+
+  pthread_mutex_lock(&ioRing.mutex);
+
+  if (channel->sending) {
+    errno = EWOULDBLOCK;
+    result = -1;}
+  else if (channel->sendError) {
+    errno = channel->sendError;
+    channel->sendError = 0;
+    result = -1;}
+  else if (count > 0) {
+    if (count > channel->sendCapacity) {
+      grown = (char *) realloc(channel->sendBuffer, count);
+      if (grown == NULL) {
+	pthread_mutex_unlock(&ioRing.mutex);
+	return -1;}
+      channel->sendBuffer = grown;
+      channel->sendCapacity = count;}
+
+    memcpy(channel->sendBuffer, source, count);
+    channel->sendStart = 0;
+    channel->sendStop = count;
+    channel->sending = submitSend(channel);
+    if (!channel->sending) {
+      errno = ENOBUFS;
+      result = -1;}}
+
+  pthread_mutex_unlock(&ioRing.mutex);
+  return result;}
+
+
+void detachFromCompletionRing(netResource *resource) {
+  ringChannel *channel = (ringChannel *) resource->channel;
+
+
+  if (channel == NULL) return;
+
+  pthread_mutex_lock(&ioRing.mutex);
+
+  channel->resource = NULL;
+  resource->channel = NULL;
+  if (channel->inFlight == 0)
+    freeChannel(channel);
+  else {
+    /*
+     * Hurry along whatever is still queued; the channel is freed
+     * when the last of it completes.
+     */
+    shutdown(channel->handle, SHUT_RDWR);
+    submitCancel(channel, ringReceive);
+    submitCancel(channel, ringPoll);
+    submitCancel(channel, ringSend);
+    submitCancel(channel, ringWriteTimeout);
+    flushSubmissions();}
+
+  pthread_mutex_unlock(&ioRing.mutex);}
+
+#else
+
+/* There is no io_uring on this platform; sockets keep their scribing threads. */
+
+int startCompletionRing(int entries) {
+  return FALSE;}
+
+
+void stopCompletionRing(void) {}
+
+
+int attachToCompletionRing(netResource *resource) {
+  return FALSE;}
+
+
+int armRingOperation(
+		     netResource *resource,
+		     thread	 *operation) {
+  return FALSE;}
+
+
+int takeReceivedBytes(
+		      netResource *resource,
+		      char	  *target,
+		      int	  count) {
+  return -1;}
+
+
+int queueSend(
+	      netResource *resource,
+	      char	  *source,
+	      int	  count) {
+  return -1;}
+
+
+void detachFromCompletionRing(netResource *resource) {}
+
+
+int completionRingDescriptor(void) {
+  return -1;}
+
+
+void serviceCompletionRing(void) {}
+
+#endif
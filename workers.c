@@ -0,0 +1,384 @@
+/*
+ * flow: a Smalltalk streaming framework
+ * version 3
+ *
+ * workers.c - pooled I/O worker threads for net resources
+ *
+ * Craig Latta
+ * netjam.org/flow
+ */
+
+/*
+ * In the scribing-threads model, each TCP socket creates two
+ * threads when it's enabled, and cancels them when it's closed.
+ * For short-lived connections, that churn costs more than the
+ * connections do, and a thread may be cancelled while it holds a
+ * lock. In the pooled workers model, an operation requested
+ * through notifySocketWhenItMayPerformTimeoutAfter() is queued as
+ * a job instead, and any idle worker from a shared pool takes it,
+ * waits in poll() for the socket (or the timeout), records the
+ * result in the resource's thread structure, and signals the same
+ * semaphore a scribing thread would have. The pool grows whenever
+ * there are more jobs than idle workers, up to a configured
+ * maximum; beyond that, jobs wait in the queue for a worker to
+ * finish. Workers are never destroyed until the pool stops.
+ *
+ * Each worker also polls an eventfd of its own. Closing a socket
+ * writes to the eventfds of the workers waiting for it, so they
+ * give up cooperatively, and waits for them to do so before the
+ * socket's memory is freed.
+ */
+
+#include "flow.h"
+extern struct VirtualMachine *vm;
+
+#ifdef LINUXISH
+
+static workerPool pool = {
+  FALSE,
+  PTHREAD_MUTEX_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+  PTHREAD_COND_INITIALIZER,
+  NULL, 0, 0, 0, 0,
+  NULL, 0, 0, 0};
+
+
+/*
+ * utilities
+ */
+
+static int waitForJob(
+		      poolWorker *worker,
+		      workerJob	 *job) {
+  /*
+   * Wait until the job's operation may be performed, its timeout
+   * elapses, or the worker is cancelled. Answer the operation's
+   * result (which a cancelled worker discards).
+   */
+
+  struct pollfd descriptors[2];
+  thread	*operation = job->operation;
+  long long	remaining;
+  int		delay, count;
+
+
+  descriptors[0].fd = job->resource->handle;
+  /* A connection completes (or fails) when the socket becomes writable. */
+  descriptors[0].events =
+    ((operation == &job->resource->writing) || (operation->operation == flowConnect))
+    ? POLLOUT
+    : POLLIN;
+  descriptors[1].fd = worker->cancellation;
+  descriptors[1].events = POLLIN;
+
+  for(;;) {
+    if (operation->timeout == -1)
+      delay = -1;
+    else {
+      remaining = operation->deadline - monotonicMilliseconds();
+      delay = (remaining < 0) ? 0 : (int) remaining;}
+
+    count = poll(
+		 descriptors,
+		 2,
+		 delay);
+    if ((count >= 0) || (errno != EINTR)) break;}
+
+  /* poll() sets no revents when it fails. */
+  if (count < 0) return error;
+  if (count == 0) return timeout;
+  if (descriptors[1].revents != 0) return error;
+  if (operation->operation == flowConnect) return connectionResult(job->resource->handle);
+
+  /* As with select(), a hangup reads as readiness; recv() reports it. */
+  return ready;}
+
+
+static int queueJob(
+		    netResource *resource,
+		    thread	*operation) {
+  /* The caller holds the pool mutex. */
+
+  workerJob *grown;
+  int	    newCapacity, index;
+
+
+  if (pool.numberOfJobs == pool.jobCapacity) {
+    newCapacity = (pool.jobCapacity == 0) ? 64 : pool.jobCapacity * 2;
+    grown = (workerJob *) malloc(newCapacity * sizeof(workerJob));
+    if (grown == NULL) return FALSE;
+
+    /* Unwrap the queue into the new space. */
+    for (index = 0; index < pool.numberOfJobs; index++)
+      grown[index] = pool.jobs[(pool.firstJob + index) % pool.jobCapacity];
+    free(pool.jobs);
+    pool.jobs = grown;
+    pool.jobCapacity = newCapacity;
+    pool.firstJob = 0;}
+
+  index = (pool.firstJob + pool.numberOfJobs++) % pool.jobCapacity;
+  pool.jobs[index].resource = resource;
+  pool.jobs[index].operation = operation;
+  return TRUE;}
+
+
+static void dropJobs(
+		     netResource *resource,
+		     thread	 *operation) {
+  /*
+   * Remove queued jobs for the given operation, or for any of the
+   * resource's operations if operation is NULL. The caller holds
+   * the pool mutex.
+   */
+
+  int index, kept = 0;
+  workerJob job;
+
+
+  for (index = 0; index < pool.numberOfJobs; index++) {
+    job = pool.jobs[(pool.firstJob + index) % pool.jobCapacity];
+    if ((job.resource == resource)
+	&& ((operation == NULL) || (job.operation == operation)))
+      continue;
+    pool.jobs[(pool.firstJob + kept++) % pool.jobCapacity] = job;}
+
+  pool.numberOfJobs = kept;}
+
+
+static void cancelWorker(poolWorker *worker) {
+  /* The caller holds the pool mutex. */
+
+  uint64_t one = 1;
+
+
+  if (worker->cancelled) return;
+  worker->cancelled = TRUE;
+  write(worker->cancellation, &one, sizeof(one));}
+
+
+/*
+ * thread functions
+ */
+
+/* Take jobs from the queue, and wait for each on behalf of its resource. */
+void runWorker(void *parameter) {
+  poolWorker *worker = (poolWorker *) parameter;
+  workerJob  job;
+  uint64_t   cancellations;
+  int	     result;
+
+
+  pthread_mutex_lock(&pool.mutex);
+  for(;;) {
+    while (pool.running && (pool.numberOfJobs == 0)) {
+      pool.idleWorkers++;
+      pthread_cond_wait(&pool.jobsPending, &pool.mutex);
+      pool.idleWorkers--;}
+    if (!pool.running) break;
+
+    job = pool.jobs[pool.firstJob];
+    pool.firstJob = (pool.firstJob + 1) % pool.jobCapacity;
+    pool.numberOfJobs--;
+    worker->job = job;
+    worker->cancelled = FALSE;
+    pthread_mutex_unlock(&pool.mutex);
+
+    result = waitForJob(worker, &job);
+
+    pthread_mutex_lock(&pool.mutex);
+    if (worker->cancelled)
+      /* The canceller wrote before setting the flag we just read. */
+      read(worker->cancellation, &cancellations, sizeof(cancellations));
+    else {
+      job.operation->result = convertedInteger(result);
+      signalThreadOperation(job.operation);}
+    worker->job.resource = NULL;
+    worker->job.operation = NULL;
+    pthread_cond_broadcast(&pool.jobFinished);}
+
+  pthread_mutex_unlock(&pool.mutex);}
+
+
+static int addWorker(void) {
+  /* The caller holds the pool mutex. */
+
+  poolWorker **grown;
+  poolWorker *worker;
+  int	     newCapacity;
+
+
+  if (pool.numberOfWorkers == pool.workerCapacity) {
+    newCapacity = (pool.workerCapacity == 0) ? 16 : pool.workerCapacity * 2;
+    grown = (poolWorker **) realloc(
+				    pool.workers,
+				    newCapacity * sizeof(poolWorker *));
+    if (grown == NULL) return FALSE;
+    pool.workers = grown;
+    pool.workerCapacity = newCapacity;}
+
+  if ((worker = (poolWorker *) calloc(1, sizeof(poolWorker))) == NULL) return FALSE;
+  worker->cancellation = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if (worker->cancellation < 0) {
+    free(worker);
+    return FALSE;}
+
+  if (!startThread(
+		   &worker->sync,
+		   runWorker,
+		   (void *) worker)) {
+    close(worker->cancellation);
+    free(worker);
+    return FALSE;}
+
+  pool.workers[pool.numberOfWorkers++] = worker;
+  return TRUE;}
+
+
+/*
+ * pool lifecycle
+ */
+
+int startWorkerPool(
+		    int numberOfWorkers,
+		    int maximumWorkers) {
+  /*
+   * There is only one pool; starting it again just makes sure it
+   * has at least the given number of workers, and sets a new
+   * maximum for its growth (which doesn't retire any workers).
+   */
+
+  int started = TRUE;
+
+
+  pthread_mutex_lock(&pool.mutex);
+  pool.running = TRUE;
+  pool.maximumWorkers = maximumWorkers;
+  while (started && (pool.numberOfWorkers < numberOfWorkers))
+    started = addWorker();
+  if (pool.numberOfWorkers == 0) pool.running = FALSE;
+  pthread_mutex_unlock(&pool.mutex);
+
+  return pool.numberOfWorkers > 0;}
+
+
+void stopWorkerPool(void) {
+  int index;
+
+
+  pthread_mutex_lock(&pool.mutex);
+  if (!pool.running) {
+    pthread_mutex_unlock(&pool.mutex);
+    return;}
+
+  pool.running = FALSE;
+  pool.numberOfJobs = 0;
+  for (index = 0; index < pool.numberOfWorkers; index++)
+    if (pool.workers[index]->job.operation != NULL)
+      cancelWorker(pool.workers[index]);
+  pthread_cond_broadcast(&pool.jobsPending);
+  pthread_mutex_unlock(&pool.mutex);
+
+  for (index = 0; index < pool.numberOfWorkers; index++) {
+    pthread_join(pool.workers[index]->sync.thread, NULL);
+    close(pool.workers[index]->cancellation);
+    free(pool.workers[index]);}
+
+  free(pool.workers);
+  free(pool.jobs);
+  pool.workers = NULL;
+  pool.jobs = NULL;
+  pool.numberOfWorkers = pool.workerCapacity = pool.idleWorkers = 0;
+  pool.firstJob = pool.jobCapacity = 0;}
+
+
+/*
+ * operations
+ */
+
+int armPooledOperation(
+		       netResource *resource,
+		       thread	   *operation) {
+  /*
+   * The operation and timeout have been read from the stack into
+   * the thread structure already.
+   */
+
+  int index;
+
+
+  pthread_mutex_lock(&pool.mutex);
+  if (!pool.running) {
+    pthread_mutex_unlock(&pool.mutex);
+    return FALSE;}
+
+  /* Rearming replaces any operation still pending in this direction. */
+  dropJobs(resource, operation);
+  for (index = 0; index < pool.numberOfWorkers; index++)
+    if (pool.workers[index]->job.operation == operation)
+      cancelWorker(pool.workers[index]);
+
+  if (operation->timeout != -1)
+    operation->deadline = monotonicMilliseconds() + operation->timeout;
+  if (!queueJob(resource, operation)) {
+    pthread_mutex_unlock(&pool.mutex);
+    return FALSE;}
+
+  /*
+   * Every idle worker takes a job when it wakes, so only jobs beyond
+   * those need a new worker. If the pool is at its maximum, or one
+   * can't be started, the job waits for a busy worker to finish.
+   */
+  if ((pool.numberOfJobs > pool.idleWorkers)
+      && (pool.numberOfWorkers < pool.maximumWorkers))
+    addWorker();
+  pthread_cond_signal(&pool.jobsPending);
+
+  pthread_mutex_unlock(&pool.mutex);
+  return TRUE;}
+
+
+void releasePooledResource(netResource *resource) {
+  /*
+   * Forget the resource's queued jobs, interrupt any workers waiting
+   * for it, and wait until they have let go of it.
+   */
+
+  int index, busy;
+
+
+  pthread_mutex_lock(&pool.mutex);
+  dropJobs(resource, NULL);
+
+  for(;;) {
+    busy = FALSE;
+    for (index = 0; index < pool.numberOfWorkers; index++)
+      if (pool.workers[index]->job.resource == resource) {
+	cancelWorker(pool.workers[index]);
+	busy = TRUE;}
+    if (!busy) break;
+    pthread_cond_wait(&pool.jobFinished, &pool.mutex);}
+
+  pthread_mutex_unlock(&pool.mutex);}
+
+#else
+
+/* Without eventfd, sockets keep their scribing threads. */
+
+int startWorkerPool(
+		    int numberOfWorkers,
+		    int maximumWorkers) {
+  return FALSE;}
+
+
+void stopWorkerPool(void) {}
+
+
+int armPooledOperation(
+		       netResource *resource,
+		       thread	   *operation) {
+  return FALSE;}
+
+
+void releasePooledResource(netResource *resource) {}
+
+#endif
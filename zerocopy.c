@@ -0,0 +1,584 @@
+/*
+ * flow: a Smalltalk streaming framework
+ * version 3
+ *
+ * zerocopy.c - zero-copy sends from native buffers
+ *
+ * Craig Latta
+ * netjam.org/flow
+ */
+
+/*
+ * An ordinary send() copies everything into kernel buffers. With
+ * MSG_ZEROCOPY, the kernel instead pins the pages being sent and
+ * transmits from them directly, which is much cheaper for large
+ * payloads. The memory can't be reused until the kernel says it's
+ * done with it, and objects in the Smalltalk heap may be moved by
+ * the garbage collector at any time, so zero-copy sends are made
+ * from send buffers in native memory.
+ *
+ * The kernel reports finished sends on each socket's error queue,
+ * as ranges of sequence numbers. A single reaper thread watches the
+ * error queues of every socket with zero-copy enabled, and signals
+ * a send buffer's semaphore once none of its sends are in flight.
+ * Sends smaller than ZeroCopyThreshold aren't worth the pinning;
+ * they're copied, and the buffer's semaphore is signalled at once.
+ */
+
+#include "flow.h"
+extern struct VirtualMachine *vm;
+
+#ifdef LINUXISH
+
+/* the epoll data of the reaper's wakeup eventfd (sockets' data are never zero) */
+#define ReaperWakeupKey 0
+
+static zeroCopyReaper reaper = {
+  -1, -1, FALSE,
+  {0},
+  PTHREAD_MUTEX_INITIALIZER,
+  NULL};
+
+
+/*
+ * utilities
+ */
+
+static void completeSends(
+			  zeroCopySends *sends,
+			  unsigned int	first,
+			  unsigned int	last,
+			  int		copied) {
+  /*
+   * Note that the sends numbered first through last are done, and
+   * signal the buffers which no longer have sends in flight. The
+   * caller holds the reaper mutex.
+   */
+
+  zeroCopySend *entry;
+  int	       index;
+
+
+  for (index = 0; index < sends->numberOfSends; index++) {
+    entry = &sends->sends[(sends->firstSend + index) % ZeroCopySendLimit];
+    /* Sequence numbers wrap; compare them as offsets from the first. */
+    if (entry->done || ((entry->sequence - first) > (last - first))) continue;
+
+    entry->done = TRUE;
+    sends->completed++;
+    if (copied) sends->copied++;
+    if (--entry->buffer->inFlight == 0)
+      synchronizedSignalSemaphoreWithIndex(entry->buffer->semaphore);}
+
+  /* Completions usually arrive in order; forget those at the front. */
+  while ((sends->numberOfSends > 0) && sends->sends[sends->firstSend].done) {
+    sends->firstSend = (sends->firstSend + 1) % ZeroCopySendLimit;
+    sends->numberOfSends--;}}
+
+
+static void readCompletions(zeroCopySends *sends) {
+  /* Take every notification on the socket's error queue. The caller holds the reaper mutex. */
+
+  char			   control[128];
+  struct msghdr		   message;
+  struct cmsghdr	   *header;
+  struct sock_extended_err *notification;
+
+
+  if (sends->released) return;
+
+  for(;;) {
+    memset(&message, 0, sizeof(message));
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    if (recvmsg(
+		sends->handle,
+		&message,
+		MSG_ERRQUEUE | MSG_DONTWAIT)
+	< 0) {
+      /* Edge-triggered: the queue must be drained before waiting again. */
+      if (errno == EINTR) continue;
+      break;}
+
+    for (header = CMSG_FIRSTHDR(&message); header != NULL; header = CMSG_NXTHDR(&message, header)) {
+      if (!(((header->cmsg_level == SOL_IP) && (header->cmsg_type == IP_RECVERR))
+	    || ((header->cmsg_level == SOL_IPV6) && (header->cmsg_type == IPV6_RECVERR))))
+	continue;
+
+      notification = (struct sock_extended_err *) CMSG_DATA(header);
+      if ((notification->ee_errno != 0) || (notification->ee_origin != SO_EE_ORIGIN_ZEROCOPY)) continue;
+      completeSends(
+		    sends,
+		    notification->ee_info,
+		    notification->ee_data,
+		    notification->ee_code & SO_EE_CODE_ZEROCOPY_COPIED);}}}
+
+
+static void freeReleased(void) {
+  /* The caller holds the reaper mutex. */
+
+  zeroCopySends *sends;
+
+
+  while ((sends = reaper.released) != NULL) {
+    reaper.released = sends->nextReleased;
+    free(sends);}}
+
+
+/*
+ * thread functions
+ */
+
+/* Wait for completions on the error queues of watched sockets. */
+void reapZeroCopyCompletions(void *parameter) {
+  struct epoll_event events[ZeroCopyEventBatchSize];
+  int		     count, index;
+
+
+  for(;;) {
+    count = epoll_wait(
+		       reaper.epoll,
+		       events,
+		       ZeroCopyEventBatchSize,
+		       -1);
+    if (!__atomic_load_n(&reaper.running, __ATOMIC_ACQUIRE)) break;
+
+    pthread_mutex_lock(&reaper.mutex);
+    for (index = 0; index < count; index++)
+      if (events[index].data.u64 != ReaperWakeupKey)
+	readCompletions((zeroCopySends *) events[index].data.ptr);
+    freeReleased();
+    pthread_mutex_unlock(&reaper.mutex);}}
+
+
+/*
+ * reaper lifecycle
+ */
+
+static int startZeroCopyReaper(void) {
+  /* The reaper starts when a socket first enables zero-copy sends. */
+
+  struct epoll_event event;
+
+
+  if (reaper.running) return TRUE;
+
+  if ((reaper.epoll = epoll_create1(EPOLL_CLOEXEC)) < 0) return FALSE;
+  reaper.wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  event.events = EPOLLIN;
+  event.data.u64 = ReaperWakeupKey;
+  reaper.running = TRUE;
+  if ((reaper.wakeup < 0)
+      || (epoll_ctl(
+		    reaper.epoll,
+		    EPOLL_CTL_ADD,
+		    reaper.wakeup,
+		    &event)
+	  < 0)
+      || !startThread(
+		      &reaper.sync,
+		      reapZeroCopyCompletions,
+		      NULL)) {
+    reaper.running = FALSE;
+    if (reaper.wakeup >= 0) close(reaper.wakeup);
+    close(reaper.epoll);
+    reaper.epoll = reaper.wakeup = -1;
+    return FALSE;}
+
+  return TRUE;}
+
+
+void stopZeroCopyReaper(void) {
+  uint64_t one = 1;
+
+
+  if (!reaper.running) return;
+
+  __atomic_store_n(&reaper.running, FALSE, __ATOMIC_RELEASE);
+  write(reaper.wakeup, &one, sizeof(one));
+  pthread_join(reaper.sync.thread, NULL);
+  freeReleased();
+  close(reaper.wakeup);
+  close(reaper.epoll);
+  reaper.epoll = reaper.wakeup = -1;}
+
+
+void releaseZeroCopy(netResource *resource) {
+  /*
+   * Stop watching the socket, and consider its sends finished; the
+   * kernel keeps its own references to the pages it still needs.
+   * The reaper frees the rest.
+   */
+
+  zeroCopySends *sends = (zeroCopySends *) resource->zeroCopy;
+  zeroCopySend	*entry;
+  int		index;
+
+
+  if (sends == NULL) return;
+
+  pthread_mutex_lock(&reaper.mutex);
+  epoll_ctl(
+	    reaper.epoll,
+	    EPOLL_CTL_DEL,
+	    sends->handle,
+	    NULL);
+  for (index = 0; index < sends->numberOfSends; index++) {
+    entry = &sends->sends[(sends->firstSend + index) % ZeroCopySendLimit];
+    if ((!entry->done) && (--entry->buffer->inFlight == 0))
+      synchronizedSignalSemaphoreWithIndex(entry->buffer->semaphore);}
+  resource->zeroCopy = NULL;
+  sends->released = TRUE;
+  sends->nextReleased = reaper.released;
+  reaper.released = sends;
+  pthread_mutex_unlock(&reaper.mutex);}
+
+
+/*
+ * primitives
+ */
+
+void newSendBufferOfSizeInto(void) {
+  /*
+   * newSendBufferOfSize: numberOfBytes
+   * into: fourByteInteger
+   */
+
+  int	     size = vm->stackIntegerValue(1);
+  int	     handleOop = vm->stackObjectValue(0);
+  sendBuffer *buffer;
+  int	     address;
+
+
+  if (!(vm->failed())) {
+    if (size <= 0) {
+      vm->primitiveFail();
+      return;}
+
+    if ((buffer = (sendBuffer *) calloc(1, sizeof(sendBuffer))) == NULL) {
+      vm->primitiveFail();
+      return;}
+
+    /* whole pages, which is what the kernel pins */
+    buffer->bytes = (char *) mmap(
+				  NULL,
+				  size,
+				  PROT_READ | PROT_WRITE,
+				  MAP_PRIVATE | MAP_ANONYMOUS,
+				  -1,
+				  0);
+    if (buffer->bytes == MAP_FAILED) {
+      free(buffer);
+      vm->primitiveFail();
+      return;}
+    buffer->size = size;
+
+    address = (int) buffer;
+    memcpy(
+	   (void *) (handleOop + BaseHeaderSize),
+	   (const void *) &address,
+	   4);
+    vm->pop(2);}}
+
+
+void registerThatSendBufferHasReusabilityIndex(void) {
+  /*
+   * registerThatSendBuffer: bufferHandle
+   * hasReusabilityIndex: semaphoreIndex
+   */
+
+  sendBuffer *buffer = (sendBuffer *) (addressForStackValue(1));
+
+
+  if (!(vm->failed())) {
+    buffer->semaphore = vm->stackIntegerValue(0);
+    vm->pop(2);}}
+
+
+void copyFromStartingAtIntoSendBufferAt(void) {
+  /*
+   * copy: numberOfBytes
+   * from: sourceByteArray
+   * startingAt: sourceStartIndex
+   * intoSendBuffer: bufferHandle
+   * at: bufferStartIndex
+   */
+
+  /* This fails while the kernel may still be sending from the buffer. */
+
+  int	     count = vm->stackIntegerValue(4);
+  int	     source = vm->stackObjectValue(3);
+  int	     sourceStart = vm->stackIntegerValue(2);
+  sendBuffer *buffer = (sendBuffer *) (addressForStackValue(1));
+  int	     bufferStart = vm->stackIntegerValue(0);
+
+
+  if (!(vm->failed())) {
+    if (!(vm->isWordsOrBytes(source))
+	|| (count < 0)
+	|| (sourceStart < 1)
+	|| ((sourceStart - 1 + count) > vm->byteSizeOf(source))
+	|| (bufferStart < 1)
+	|| ((bufferStart - 1 + count) > buffer->size)
+	|| (__atomic_load_n(&buffer->inFlight, __ATOMIC_ACQUIRE) > 0)) {
+      vm->primitiveFail();
+      return;}
+
+    memcpy(
+	   buffer->bytes + bufferStart - 1,
+	   (char *) (source + BaseHeaderSize + sourceStart - 1),
+	   count);
+    vm->pop(5);}}
+
+
+void freeSendBuffer(void) {
+  /* freeSendBuffer: bufferHandle */
+
+  /* This fails while the kernel may still be sending from the buffer. */
+
+  sendBuffer *buffer = (sendBuffer *) (addressForStackValue(0));
+
+
+  if (!(vm->failed())) {
+    if (__atomic_load_n(&buffer->inFlight, __ATOMIC_ACQUIRE) > 0) {
+      vm->primitiveFail();
+      return;}
+
+    munmap(buffer->bytes, buffer->size);
+    free(buffer);
+    vm->pop(1);}}
+
+
+void enableZeroCopyForTCPSocket(void) {
+  /* enableZeroCopyFor: tcpSocketHandle */
+
+  /*
+   * Sockets using the completion ring send through it instead, and
+   * can't make zero-copy sends.
+   */
+
+  flowSocket	*socketPointer = (flowSocket *) (addressForStackValue(0));
+  zeroCopySends *sends;
+  int		one = 1;
+  struct epoll_event event;
+
+
+  if (!(vm->failed())) {
+    if (socketPointer->resource.zeroCopy != NULL) {
+      vm->pop(1);
+      return;}
+
+    if ((socketPointer->resource.model == completionRingModel)
+	|| (setsockopt(
+		       socketPointer->resource.handle,
+		       SOL_SOCKET,
+		       SO_ZEROCOPY,
+		       &one,
+		       sizeof(one))
+	    < 0)
+	|| ((sends = (zeroCopySends *) calloc(1, sizeof(zeroCopySends))) == NULL)) {
+      vm->primitiveFail();
+      return;}
+
+    pthread_mutex_lock(&reaper.mutex);
+    /*
+     * Error queue notifications always wake epoll; no events need
+     * asking for. Edge-triggered, since a reset or finished peer
+     * leaves EPOLLERR or EPOLLHUP asserted until the image closes
+     * the socket, whereas each new notification is a fresh edge.
+     */
+    event.events = EPOLLET;
+    sends->handle = socketPointer->resource.handle;
+    event.data.ptr = sends;
+    if (!startZeroCopyReaper()
+	|| (epoll_ctl(
+		      reaper.epoll,
+		      EPOLL_CTL_ADD,
+		      socketPointer->resource.handle,
+		      &event)
+	    < 0)) {
+      pthread_mutex_unlock(&reaper.mutex);
+      free(sends);
+      vm->primitiveFail();
+      return;}
+    socketPointer->resource.zeroCopy = sends;
+    pthread_mutex_unlock(&reaper.mutex);
+
+    vm->pop(1);}}
+
+
+void nextPutFromSendBufferStartingAtToTCPSocket(void) {
+  /*
+   * nextPut: numberOfBytes
+   * fromSendBuffer: bufferHandle
+   * startingAt: bufferStartIndex
+   * to: tcpSocketHandle
+   */
+
+  /*
+   * Send from the buffer without waiting, and answer how many bytes
+   * were sent, as nextPut:from:to:startingAt: does. Once the kernel
+   * is done with the buffer, its semaphore is signalled; until then,
+   * it must not be changed. Sends made while too many are already in
+   * flight fail, as do sends to sockets with send queues (which
+   * would reorder the data).
+   */
+
+  int		count = vm->stackIntegerValue(3);
+  sendBuffer	*buffer = (sendBuffer *) (addressForStackValue(2));
+  int		start = vm->stackIntegerValue(1);
+  flowSocket	*socketPointer = (flowSocket *) (addressForStackValue(0));
+  zeroCopySends *sends;
+  zeroCopySend	*entry;
+  int		result;
+
+
+  if (!(vm->failed())) {
+    if ((count < 0)
+	|| (start < 1)
+	|| ((start - 1 + count) > buffer->size)
+	|| (socketPointer->resource.model == completionRingModel)
+	|| (socketPointer->resource.sendQueue != NULL)) {
+      vm->primitiveFail();
+      return;}
+
+    sends = (zeroCopySends *) socketPointer->resource.zeroCopy;
+    if ((sends == NULL) || (count < ZeroCopyThreshold)) {
+      /*
+       * Copy, as usual. The buffer may be reused right away, unless
+       * earlier zero-copy sends from it are still in flight; the
+       * reaper signals when the last of those is done.
+       */
+      result = send(
+		    socketPointer->resource.handle,
+		    buffer->bytes + start - 1,
+		    count,
+		    MSG_DONTWAIT);
+      countTransfer(
+		    socketPointer,
+		    &socketPointer->resource.writing,
+		    result,
+		    wouldHaveBlocked(result));
+      if (result == -1) {
+	vm->primitiveFail();
+	return;}
+
+      pthread_mutex_lock(&reaper.mutex);
+      if (buffer->inFlight == 0)
+	synchronizedSignalSemaphoreWithIndex(buffer->semaphore);
+      pthread_mutex_unlock(&reaper.mutex);
+      socketPointer->resource.writing.result = convertedInteger(result);
+      vm->pop(5);
+      vm->pushInteger(result);
+      return;}
+
+    pthread_mutex_lock(&reaper.mutex);
+    if (sends->numberOfSends == ZeroCopySendLimit) {
+      pthread_mutex_unlock(&reaper.mutex);
+      vm->primitiveFail();
+      return;}
+
+    result = send(
+		  socketPointer->resource.handle,
+		  buffer->bytes + start - 1,
+		  count,
+		  MSG_ZEROCOPY | MSG_DONTWAIT);
+    countTransfer(
+		  socketPointer,
+		  &socketPointer->resource.writing,
+		  result,
+		  wouldHaveBlocked(result));
+    if (result == -1) {
+      pthread_mutex_unlock(&reaper.mutex);
+      vm->primitiveFail();
+      return;}
+
+    /* Each successful zero-copy send takes the next sequence number. */
+    entry = &sends->sends[(sends->firstSend + sends->numberOfSends++) % ZeroCopySendLimit];
+    entry->sequence = sends->nextSequence++;
+    entry->buffer = buffer;
+    entry->done = FALSE;
+    buffer->inFlight++;
+    pthread_mutex_unlock(&reaper.mutex);
+
+    socketPointer->resource.writing.result = convertedInteger(result);
+    vm->pop(5);
+    vm->pushInteger(result);}}
+
+
+void zeroCopyStatisticsForSocketInto(void) {
+  /*
+   * zeroCopyStatisticsFor: tcpSocketHandle
+   * into: twelveByteArray
+   */
+
+  /*
+   * Write how many zero-copy sends are in flight, how many have
+   * completed, and how many of those the kernel copied after all
+   * (as it does over loopback, for example), as three four-byte
+   * integers.
+   */
+
+  flowSocket	*socketPointer = (flowSocket *) (addressForStackValue(1));
+  int		statistics = vm->stackObjectValue(0);
+  zeroCopySends *sends;
+  unsigned int	counts[3] = {0, 0, 0};
+
+
+  if (!(vm->failed())) {
+    if (!(vm->fetchClassOf(statistics) == (vm->classByteArray()))
+	|| (vm->byteSizeOf(statistics) < sizeof(counts))) {
+      vm->primitiveFail();
+      return;}
+
+    pthread_mutex_lock(&reaper.mutex);
+    if ((sends = (zeroCopySends *) socketPointer->resource.zeroCopy) != NULL) {
+      counts[0] = sends->numberOfSends;
+      counts[1] = sends->completed;
+      counts[2] = sends->copied;}
+    pthread_mutex_unlock(&reaper.mutex);
+
+    memcpy(
+	   (void *) (statistics + BaseHeaderSize),
+	   counts,
+	   sizeof(counts));
+    vm->pop(2);}}
+
+#else
+
+/* MSG_ZEROCOPY is Linux's; elsewhere, there are no zero-copy sends. */
+
+void releaseZeroCopy(netResource *resource) {}
+
+
+void stopZeroCopyReaper(void) {}
+
+
+void newSendBufferOfSizeInto(void) {
+  vm->primitiveFail();}
+
+
+void registerThatSendBufferHasReusabilityIndex(void) {
+  vm->primitiveFail();}
+
+
+void copyFromStartingAtIntoSendBufferAt(void) {
+  vm->primitiveFail();}
+
+
+void freeSendBuffer(void) {
+  vm->primitiveFail();}
+
+
+void enableZeroCopyForTCPSocket(void) {
+  vm->primitiveFail();}
+
+
+void nextPutFromSendBufferStartingAtToTCPSocket(void) {
+  vm->primitiveFail();}
+
+
+void zeroCopyStatisticsForSocketInto(void) {
+  vm->primitiveFail();}
+
+#endif